@@ -25,12 +25,22 @@
  * Options:  -n    Don't do anything, just report what would be done.
  *	     -q    Don't report dumped fonts.
  *	     -v    Enable verbose reporting.
- * Input:    A Macintosh file in MacBinary format.
+ * Input:    A Macintosh file in MacBinary, AppleSingle, or AppleDouble
+ *	     format, or a raw resource fork or data fork suitcase (.dfont),
+ *	     or an HFS or HFS+ disk image containing such files.
  * Output:   Zero or more Adobe BDF files, one for each font resource.  The
  *	     names chosen for output font files are generated based on the
  *	     font family, style, and size.  Existing files with the same names
  *	     are silently replaced.  If you wish to know which files will be
  *	     produced, use the [-n] option prior to doing the real conversion.
+ *	     Optionally, a binary metrics sidecar (.fmx) holding the FOND
+ *	     width and kerning tables is written for each font family.
+ *	     Optionally, each font is also written as a PGM glyph atlas
+ *	     (.pgm) with packed per-glyph metrics (.atl), or as a C
+ *	     header (.h) of constant glyph tables for embedding, or in
+ *	     the compact binary MFNT format (.mfn) described in mfnt.h.
+ *	     Fonts of 2, 4, or 8 bits per pixel are thresholded at half
+ *	     ink for BDF; the atlas and MFNT outputs keep their levels.
  * Comments: The Mac font format does not have all of the information one
  *	     would normally place in a BDF file; e.g., glyph names are not
  *           specified in the Mac font resources.  Consequently, the names
@@ -46,8 +56,13 @@
  *		      -- field for large bitmaps.
  *           08/19/93 -- Modifications by Norm Walsh.
  * Notes:    1. Orphaned font resources are not yet handled.
- *	     2. Prefixes B,I,BI,Sb,SbI need to be removed.
- *	     3. Add option to specify family, size, style to dump.
+ *	     2. Add option to specify family, size, style to dump.
+ *	     3. LoadResource expands compressed resources, but only
+ *		those of 'dcmp' (2) with their own table; 'dcmp' (0) and
+ *		(1), and 'dcmp' (2) with the System's default table, as
+ *		found in System files, depend on fixed tables in the
+ *		System file that aren't reproduced here, and are skipped
+ *		with a warning.
  * Authors:  Glenn Adams <glenn@metis.com> (original code)
  *           Norm Walsh <walsh@cs.umass.edu> (modifications)
  *
@@ -57,11 +72,12 @@
  *    with little error checking or view towards portability.
  * 2. This program has only been compiled and run on SunOS 4.1.1. It may not
  *    compile on other platforms, let alone even run.
- * 3. The only input this program accepts is a MacBinary format file which
- *    was created by using NCSA Telnet to FTP standard Mac files (containing
- *    both data and resource forks) to a Sun system. It may also work with
- *    MacBinary files as transferred by other terminal emulator programs;
- *    however, this has not been tested.
+ * 3. This program was first written for MacBinary files created by using
+ *    NCSA Telnet to FTP standard Mac files (containing both data and
+ *    resource forks) to a Sun system.  It now also recognizes AppleSingle
+ *    and AppleDouble files, raw resource forks, and data fork suitcases
+ *    (.dfont) by their contents, but has seen little testing with files
+ *    produced by other transfer programs or archivers.
  * 4. This program is being released in this form in the hope that it will
  *    be useful to someone without all the frills one would expect from a
  *    robust program; this program does not make any claims to robustness.
@@ -75,17 +91,68 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define  MFNT_NOREADER
+#include "mfnt.h"
+
+#if defined(__GNUC__) && ( defined(__i386__) || defined(__x86_64__) )
+#define  X86KERNELS
+#include <immintrin.h>
+#endif
 
 #define  DEVXRES	72	/* Macintosh X-Resolution */
 #define  DEVYRES	72	/* Macintosh Y-Resolution */
 
+#define  CACHEVERSION	3	/* bump whenever BDF output changes */
+#define  MANIFESTHASH	4096	/* manifest hash table size */
+#define  GLYPHHASH	16384	/* glyph intern table size */
+#define  MAXFONTTABLE	258	/* NFNT glyph table entries, for chars 0-255 */
+
+#define  CMPSIGNATURE	0xa89f6572	/* compressed resource signature */
+
+#define  ASMAGIC	0x00051600	/* AppleSingle magic number */
+#define  ADMAGIC	0x00051607	/* AppleDouble magic number */
+#define  ASRSRCFORK	2		/* AppleSingle resource fork entry */
+
+#define  DDRSIGNATURE	0x4552		/* driver descriptor signature, 'ER' */
+#define  PMSIGNATURE	0x504d		/* partition map signature, 'PM' */
+#define  HFSSIGNATURE	0x4244		/* HFS volume signature, 'BD' */
+#define  HFSPSIGNATURE	0x482b		/* HFS+ volume signature, 'H+' */
+#define  HFSXSIGNATURE	0x4858		/* HFSX volume signature, 'HX' */
+#define  VHDROFFSET	1024		/* offset of volume header */
+#define  DC42HDRLEN	84		/* DiskCopy 4.2 image header length */
+#define  MAXEXTENTS	8		/* maximum extents per fork */
+
+#define  METRICSMAGIC	"FMTX"		/* metrics sidecar magic number */
+#define  METRICSVERSION	1		/* metrics sidecar format version */
+
+#define  NSTYLEINDEX	48		/* style-mapping table indices */
+
+#define  ATLASMAGIC	"FATL"		/* glyph atlas metrics magic number */
+#define  ATLASVERSION	1		/* glyph atlas metrics format version */
+
 typedef	char		INT8;
 typedef	short		INT16;
-typedef	long		INT32;
+typedef	int		INT32;
 
 typedef	unsigned char	CARD8;
 typedef	unsigned short	CARD16;
-typedef	unsigned long	CARD32;
+typedef	unsigned int	CARD32;
+
+/*
+ * Compile-time check that TYPE is SIZE bytes, as laid out on disk.
+ */
+#define  SIZECHECK(type,size)	\
+  typedef char type##SizeCheck [ ( sizeof (type) == (size) ) ? 1 : -1 ]
+
+SIZECHECK ( INT16,  2 );
+SIZECHECK ( INT32,  4 );
+SIZECHECK ( CARD16, 2 );
+SIZECHECK ( CARD32, 4 );
 
 typedef struct _MacBinHdrRec MacBinHdrRec, *MacBinHdr;
 struct _MacBinHdrRec {
@@ -103,6 +170,21 @@ struct _MacBinHdrRec {
 
 #define RHDRLEN		       256	/* total header length */
 
+typedef struct _AppleSingleHdrRec AppleSingleHdrRec, *AppleSingleHdr;
+struct _AppleSingleHdrRec {
+  CARD8		asMagic      [   4 ];
+  CARD8		asVersion    [   4 ];
+  CARD8		asFiller     [  16 ];
+  CARD8		asNumEntries [   2 ];
+};
+
+typedef struct _AppleSingleEntRec AppleSingleEntRec, *AppleSingleEnt;
+struct _AppleSingleEntRec {
+  CARD8		aeIdent      [   4 ];
+  CARD8		aeOffset     [   4 ];
+  CARD8		aeLength     [   4 ];
+};
+
 typedef struct _RsrcHdrRec RsrcHdrRec, *RsrcHdr;
 struct _RsrcHdrRec {
   CARD8         rhDataOffset [   4 ];
@@ -137,6 +219,165 @@ struct _RsrcRefRec {
   CARD8         rrReserved   [   4 ];
 };
 
+typedef struct _CmpRsrcHdrRec CmpRsrcHdrRec, *CmpRsrcHdr;
+struct _CmpRsrcHdrRec {
+  CARD8		chSignature  [   4 ];
+  CARD8		chHdrLen     [   2 ];
+  CARD8		chVersion    [   1 ];
+  CARD8		chAttr       [   1 ];
+  CARD8		chLength     [   4 ];
+  CARD8		chParams     [   6 ];
+};
+
+typedef struct _PartMapRec PartMapRec, *PartMap;
+struct _PartMapRec {
+  CARD8		pmSig        [   2 ];
+  CARD8		pmSigPad     [   2 ];
+  CARD8		pmMapBlkCnt  [   4 ];
+  CARD8		pmPyPartStart[   4 ];
+  CARD8		pmPartBlkCnt [   4 ];
+  CARD8		pmPartName   [  32 ];
+  CARD8		pmParType    [  32 ];
+};
+
+typedef struct _HfsMdbRec HfsMdbRec, *HfsMdb;
+struct _HfsMdbRec {
+  CARD8		drSigWord    [   2 ];
+  CARD8		drCrDate     [   4 ];
+  CARD8		drLsMod      [   4 ];
+  CARD8		drAtrb       [   2 ];
+  CARD8		drNmFls      [   2 ];
+  CARD8		drVBMSt      [   2 ];
+  CARD8		drAllocPtr   [   2 ];
+  CARD8		drNmAlBlks   [   2 ];
+  CARD8		drAlBlkSiz   [   4 ];
+  CARD8		drClpSiz     [   4 ];
+  CARD8		drAlBlSt     [   2 ];
+  CARD8		drNxtCNID    [   4 ];
+  CARD8		drFreeBks    [   2 ];
+  CARD8		drVN         [  28 ];
+  CARD8		drVolBkUp    [   4 ];
+  CARD8		drVSeqNum    [   2 ];
+  CARD8		drWrCnt      [   4 ];
+  CARD8		drXTClpSiz   [   4 ];
+  CARD8		drCTClpSiz   [   4 ];
+  CARD8		drNmRtDirs   [   2 ];
+  CARD8		drFilCnt     [   4 ];
+  CARD8		drDirCnt     [   4 ];
+  CARD8		drFndrInfo   [  32 ];
+  CARD8		drEmbedSigWord[  2 ];
+  CARD8		drEmbedExtent[   4 ];
+  CARD8		drXTFlSize   [   4 ];
+  CARD8		drXTExtRec   [  12 ];
+  CARD8		drCTFlSize   [   4 ];
+  CARD8		drCTExtRec   [  12 ];
+};
+
+typedef struct _HfsPlusForkRec HfsPlusForkRec, *HfsPlusFork;
+struct _HfsPlusForkRec {
+  CARD8		fkLogicalSize[   8 ];
+  CARD8		fkClumpSize  [   4 ];
+  CARD8		fkTotalBlocks[   4 ];
+  CARD8		fkExtents    [  64 ];
+};
+
+typedef struct _HfsPlusVolHdrRec HfsPlusVolHdrRec, *HfsPlusVolHdr;
+struct _HfsPlusVolHdrRec {
+  CARD8		vhSignature  [   2 ];
+  CARD8		vhVersion    [   2 ];
+  CARD8		vhAttributes [   4 ];
+  CARD8		vhLastMounted[   4 ];
+  CARD8		vhJournalBlk [   4 ];
+  CARD8		vhCreateDate [   4 ];
+  CARD8		vhModifyDate [   4 ];
+  CARD8		vhBackupDate [   4 ];
+  CARD8		vhCheckedDate[   4 ];
+  CARD8		vhFileCount  [   4 ];
+  CARD8		vhFolderCount[   4 ];
+  CARD8		vhBlockSize  [   4 ];
+  CARD8		vhTotalBlocks[   4 ];
+  CARD8		vhFreeBlocks [   4 ];
+  CARD8		vhNextAlloc  [   4 ];
+  CARD8		vhRsrcClump  [   4 ];
+  CARD8		vhDataClump  [   4 ];
+  CARD8		vhNextCNID   [   4 ];
+  CARD8		vhWriteCount [   4 ];
+  CARD8		vhEncodings  [   8 ];
+  CARD8		vhFinderInfo [  32 ];
+  HfsPlusForkRec vhAllocFile;
+  HfsPlusForkRec vhExtentsFile;
+  HfsPlusForkRec vhCatalogFile;
+  HfsPlusForkRec vhAttribFile;
+  HfsPlusForkRec vhStartupFile;
+};
+
+typedef struct _BTNodeDescRec BTNodeDescRec, *BTNodeDesc;
+struct _BTNodeDescRec {
+  CARD8		ndFLink      [   4 ];
+  CARD8		ndBLink      [   4 ];
+  CARD8		ndType       [   1 ];
+  CARD8		ndHeight     [   1 ];
+  CARD8		ndNRecs      [   2 ];
+  CARD8		ndResv2      [   2 ];
+};
+
+typedef struct _BTHdrRec BTHdrRec, *BTHdr;
+struct _BTHdrRec {
+  CARD8		bthDepth     [   2 ];
+  CARD8		bthRoot      [   4 ];
+  CARD8		bthNRecs     [   4 ];
+  CARD8		bthFNode     [   4 ];
+  CARD8		bthLNode     [   4 ];
+  CARD8		bthNodeSize  [   2 ];
+  CARD8		bthKeyLen    [   2 ];
+  CARD8		bthNNodes    [   4 ];
+  CARD8		bthFree      [   4 ];
+};
+
+typedef struct _HfsCatFileRec HfsCatFileRec, *HfsCatFile;
+struct _HfsCatFileRec {
+  CARD8		cdrType      [   1 ];
+  CARD8		cdrResrv2    [   1 ];
+  CARD8		filFlags     [   1 ];
+  CARD8		filTyp       [   1 ];
+  CARD8		filUsrWds    [  16 ];
+  CARD8		filFlNum     [   4 ];
+  CARD8		filStBlk     [   2 ];
+  CARD8		filLgLen     [   4 ];
+  CARD8		filPyLen     [   4 ];
+  CARD8		filRStBlk    [   2 ];
+  CARD8		filRLgLen    [   4 ];
+  CARD8		filRPyLen    [   4 ];
+  CARD8		filCrDat     [   4 ];
+  CARD8		filMdDat     [   4 ];
+  CARD8		filBkDat     [   4 ];
+  CARD8		filFndrInfo  [  16 ];
+  CARD8		filClpSize   [   2 ];
+  CARD8		filExtRec    [  12 ];
+  CARD8		filRExtRec   [  12 ];
+  CARD8		filResrv     [   4 ];
+};
+
+typedef struct _HfsPlusCatFileRec HfsPlusCatFileRec, *HfsPlusCatFile;
+struct _HfsPlusCatFileRec {
+  CARD8		pfRecordType [   2 ];
+  CARD8		pfFlags      [   2 ];
+  CARD8		pfReserved1  [   4 ];
+  CARD8		pfFileID     [   4 ];
+  CARD8		pfCreateDate [   4 ];
+  CARD8		pfModDate    [   4 ];
+  CARD8		pfAttribDate [   4 ];
+  CARD8		pfAccessDate [   4 ];
+  CARD8		pfBackupDate [   4 ];
+  CARD8		pfPermissions[  16 ];
+  CARD8		pfUserInfo   [  16 ];
+  CARD8		pfFinderInfo [  16 ];
+  CARD8		pfTextEncoding[  4 ];
+  CARD8		pfReserved2  [   4 ];
+  HfsPlusForkRec pfDataFork;
+  HfsPlusForkRec pfRsrcFork;
+};
+
 typedef struct _FontRsrcRec FontRsrcRec, *FontRsrc;
 struct _FontRsrcRec {
   CARD8		ftFontType   [   2 ];
@@ -154,6 +395,25 @@ struct _FontRsrcRec {
   CARD8		ftRowWords   [   2 ];
 };
 
+/*
+ * Font color table ('fctb'), giving the color of each pixel value of a
+ * font deeper than 1 bit.
+ */
+typedef struct _ColorTableRec ColorTableRec, *ColorTable;
+struct _ColorTableRec {
+  CARD8		ctSeed	     [   4 ];
+  CARD8		ctFlags	     [   2 ];
+  CARD8		ctSize	     [   2 ];	/* entries - 1 */
+};
+
+typedef struct _ColorSpecRec ColorSpecRec, *ColorSpec;
+struct _ColorSpecRec {
+  CARD8		csValue	     [   2 ];
+  CARD8		csRed	     [   2 ];
+  CARD8		csGreen	     [   2 ];
+  CARD8		csBlue	     [   2 ];
+};
+
 typedef struct _FondRsrcRec FondRsrcRec, *FondRsrc;
 struct _FondRsrcRec {
   CARD8		fdFlags	     [   2 ];
@@ -172,20 +432,243 @@ struct _FondRsrcRec {
   CARD8		fdVersion    [   2 ];
 };
 
+SIZECHECK ( MacBinHdrRec,	 128 );
+SIZECHECK ( AppleSingleHdrRec,	  26 );
+SIZECHECK ( AppleSingleEntRec,	  12 );
+SIZECHECK ( RsrcHdrRec,		  16 );
+SIZECHECK ( RsrcMapRec,		  28 );
+SIZECHECK ( RsrcTypeRec,	   8 );
+SIZECHECK ( RsrcRefRec,		  12 );
+SIZECHECK ( CmpRsrcHdrRec,	  18 );
+SIZECHECK ( PartMapRec,		  80 );
+SIZECHECK ( HfsMdbRec,		 162 );
+SIZECHECK ( HfsPlusForkRec,	  80 );
+SIZECHECK ( HfsPlusVolHdrRec,	 512 );
+SIZECHECK ( BTNodeDescRec,	  14 );
+SIZECHECK ( BTHdrRec,		  30 );
+SIZECHECK ( HfsCatFileRec,	 102 );
+SIZECHECK ( HfsPlusCatFileRec,	 248 );
+SIZECHECK ( FontRsrcRec,	  26 );
+SIZECHECK ( ColorTableRec,	   8 );
+SIZECHECK ( ColorSpecRec,	   8 );
+SIZECHECK ( FondRsrcRec,	  52 );
+
 typedef struct _FontNameRec FontNameRec, *FontName;
 struct _FontNameRec {
   char *	name;
+  char *	fullname;	/* canonical name, including style */
   int		resource_id;
   int		size;
   int		style;
   FontName	next;
 };
 
+/*
+ * Metrics sidecar, written in host byte order so that it can be mapped
+ * and used in place: a header, followed by the width tables as arrays
+ * of styles and of widths (one row of MHNCHARS per style), followed by
+ * the kerning tables, each of which is a descriptor, a 257 entry index
+ * of the first pair for each first character, and its pairs, sorted by
+ * first and second character.  Widths and kerning distances are 4.12
+ * fixed point fractions of the em.  Sections are 4-byte aligned.
+ */
+typedef struct _MetricsHdrRec MetricsHdrRec, *MetricsHdr;
+struct _MetricsHdrRec {
+  char		mhMagic      [   4 ];
+  CARD16	mhByteOrder;
+  CARD16	mhVersion;
+  INT16		mhFamID;
+  CARD16	mhFirst;
+  CARD16	mhLast;
+  CARD16	mhNWidths;
+  CARD16	mhNKerns;
+  CARD16	mhPad;
+  unsigned int	mhWidthOff;
+  unsigned int	mhKernOff;
+};
+
+#define MHNCHARS(mh)	( (mh)->mhLast - (mh)->mhFirst + 3 )
+
+typedef struct _MetricsKernRec MetricsKernRec, *MetricsKern;
+struct _MetricsKernRec {
+  CARD16	mkStyle;
+  CARD16	mkPad;
+  unsigned int	mkNPairs;
+  unsigned int	mkIndexOff;
+  unsigned int	mkPairOff;
+};
+
+typedef struct _MetricsPairRec MetricsPairRec, *MetricsPair;
+struct _MetricsPairRec {
+  CARD8		mpFirst;
+  CARD8		mpSecond;
+  INT16		mpKern;
+};
+
+/*
+ * Glyph atlas metrics, written in host byte order next to a PGM atlas
+ * image so that it can be copied straight into GPU buffers.  A header
+ * is followed by one record per glyph, in character code order.
+ * Bearings are those of the BDF BBX; the atlas rectangle is empty for
+ * blank glyphs.
+ */
+typedef struct _AtlasHdrRec AtlasHdrRec, *AtlasHdr;
+struct _AtlasHdrRec {
+  char		ahMagic      [   4 ];
+  CARD16	ahByteOrder;
+  CARD16	ahVersion;
+  CARD16	ahNGlyphs;
+  CARD16	ahWidth;
+  CARD16	ahHeight;
+  INT16		ahAscent;
+  INT16		ahDescent;
+  CARD16	ahPad;
+};
+
+typedef struct _AtlasGlyphRec AtlasGlyphRec, *AtlasGlyph;
+struct _AtlasGlyphRec {
+  CARD16	agCode;
+  INT16		agAdvance;
+  INT16		agXOff;
+  INT16		agYOff;
+  CARD16	agX;
+  CARD16	agY;
+  CARD16	agWidth;
+  CARD16	agHeight;
+};
+
+SIZECHECK ( MetricsHdrRec,	  28 );
+SIZECHECK ( MetricsKernRec,	  16 );
+SIZECHECK ( MetricsPairRec,	   4 );
+SIZECHECK ( AtlasHdrRec,	  20 );
+SIZECHECK ( AtlasGlyphRec,	  16 );
+SIZECHECK ( MfntHdrRec,		  52 );
+
+typedef struct _VolExtentRec VolExtentRec, *VolExtent;
+struct _VolExtentRec {
+  CARD32	start;
+  CARD32	count;
+};
+
+typedef struct _VolumeRec VolumeRec, *Volume;
+struct _VolumeRec {
+  FILE *	vf;
+  long		base;
+  CARD32	blksize;
+  int		plus;
+  int		ncatext;
+  VolExtentRec	catext [ MAXEXTENTS ];
+};
+
+/*
+ * NFNT glyph tables of one font, in host byte order: location, offset/
+ * width and, if present, glyph height, each with lastChar - firstChar + 3
+ * entries.  Maxwidth is the width of the widest glyph in the strike, and
+ * length that of the font data, header through its last table.  Fonts
+ * deeper than 1 bit map each pixel value to an ink level, 0 for paper to
+ * 255 for full ink.
+ */
+typedef struct _FontTablesRec FontTablesRec, *FontTables;
+struct _FontTablesRec {
+  int		n;
+  int		hasht;
+  int		maxwidth;
+  CARD32	length;
+  int		depth;
+  CARD8		levels [ 256 ];
+  CARD16	loc [ MAXFONTTABLE ];
+  CARD16	ow  [ MAXFONTTABLE ];
+  CARD16	ht  [ MAXFONTTABLE ];
+};
+
+/*
+ * Interned glyph: packed bitmap, rows MSB first and padded to bytes, as
+ * in BDF, with its metrics.  Glyphs of fonts deeper than 1 bit also keep
+ * their ink levels, a byte per pixel, from which the bitmap is
+ * thresholded.  Identical glyphs in any font share one.
+ */
+typedef struct _GlyphRec GlyphRec, *Glyph;
+struct _GlyphRec {
+  CARD32	hash;
+  INT16		width;
+  INT16		height;
+  INT16		xoff;
+  INT16		yoff;
+  INT16		advance;
+  int		nbytes;
+  int		refs;
+  int		index;
+  CARD8 *	bits;
+  CARD8 *	gray;		/* ink levels, or NULL */
+  Glyph		next;
+};
+
+/*
+ * Glyph of the font being dumped, for glyph sinks.
+ */
+typedef struct _FontGlyphRec FontGlyphRec, *FontGlyph;
+struct _FontGlyphRec {
+  CARD16	code;
+  Glyph		glyph;
+};
+
+/*
+ * Glyph kernels for one CPU tier.  Kernels of all tiers produce
+ * identical results; they differ only in speed.
+ */
+typedef struct _KernelsRec KernelsRec, *Kernels;
+struct _KernelsRec {
+  char *	name;
+  int		(*supported) ();
+  void		(*extract) ();	/* strike to packed rows */
+  void		(*gray) ();	/* deep strike to pixel values */
+  int		(*hexrow) ();	/* packed row to hex line */
+};
+
+typedef struct _OutputNameRec OutputNameRec, *OutputName;
+struct _OutputNameRec {
+  char *	name;
+  OutputName	next;
+};
+
+typedef struct _ManifestRec ManifestRec, *Manifest;
+struct _ManifestRec {
+  char *	path;
+  long		size;
+  long		mtime;
+  OutputName	outputs;
+  Manifest	next;
+};
+
 char *		progname;
 int		nodump;
 int		quiet;
 int		verbose;
 FontName	fontnames;
+char *		cachedir;
+int		cachehits;
+int		cachemisses;
+Manifest	manifest [ MANIFESTHASH ];
+Manifest	manifestcur;
+int		verifyheights;
+int		dedupglyphs;
+Glyph		glyphhash [ GLYPHHASH ];
+int		nglyphs;
+int		nuniqueglyphs;
+long		glyphbytes;
+long		uniqueglyphbytes;
+int		atlasfonts;
+int		ctablefonts;
+int		binaryfonts;
+int		packbinary;
+char *		kerneltier;
+Kernels		kernels;
+
+/*
+ * Output modes that consume extracted glyphs; BDF cache hits can't
+ * serve these.
+ */
+#define  GLYPHSINKS	( atlasfonts || ctablefonts || binaryfonts )
 
 char *
 strdup (s)
@@ -214,7 +697,8 @@ CARD32
   toulong ( p )
 CARD8 *p;
 {
-  return (CARD32) ( ( p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3] );
+  return ( (CARD32) p[0] << 24 ) | ( (CARD32) p[1] << 16 ) |
+    ( (CARD32) p[2] << 8 ) | (CARD32) p[3];
 }
 
 INT32
@@ -225,201 +709,2738 @@ CARD8 *p;
 }
 
 /*
- * Find font bounding box and total number of glyphs.
+ * Determine if LENGTH bytes at offset OFF in file RF hold a plausible
+ * resource fork, i.e., its header's data and map lie within the fork.
  */
-void
-  FontInfo ( fp, ret_top, ret_left, ret_bottom, ret_right, ret_ng )
-register FontRsrc fp;
-INT16	*ret_top;
-INT16	*ret_left;
-INT16	*ret_bottom;
-INT16	*ret_right;
-INT16	*ret_ng;
+int
+  IsResourceFork ( rf, off, length )
+FILE  *	 rf;
+CARD32	 off;
+CARD32	 length;
 {
-  register int i, j, bit;
-  register CARD16 *bp;
-  register CARD8  *gp;
-  CARD16   g, fg, lg, coff0, coff1, ow, wo;
-  INT16    mk, wd, ht, rw, xoff, top, bot, left, right, ng;
-  CARD8 *  bitImage;
-  CARD8 *  locTable;
-  CARD8 *  owTable;
-
-  top = bot = left = right = 0;
-
-  fg = toushort ( fp->ftFirstChar   );
-  lg = toushort ( fp->ftLastChar    );
-  mk = toshort  ( fp->ftKernMax     );
-  wd = toshort  ( fp->ftFRectWidth  );
-  ht = toshort  ( fp->ftFRectHeight );
-  wo = toushort ( fp->ftOWTLoc      );
-  rw = toshort  ( fp->ftRowWords    );
-
-  bitImage = (CARD8 * ) & fp [ 1 ];
-  locTable = & bitImage     [ ( rw * ht ) << 1     ];
-#ifdef notdef
-  owTable  = & fp->ftOWTLoc [ wo          << 1     ];
-#else
-  owTable  = & locTable     [ ( lg - fg + 3 ) << 1 ];
-#endif
-
-  if ( lg == fg )
-    return;
-
-  if ( (CARD32) bitImage & 0x1 ) {
-    bp = (CARD16 *) alloca ( ht * rw * 2 );
-    (void) memcpy ( (char *) bp, (char *) bitImage, ht * rw * 2 );
-  } else
-    bp = (CARD16 *) bitImage;
+  RsrcHdrRec rhrec;
+  CARD32   doff, moff, dlen, mlen;
 
-  gp = (CARD8 *) alloca ( wd * ht );
-  (void) memset ( (char *) gp, 0, wd * ht );
-
-  for ( g = fg, ng = 0; g <= lg; g++ ) {
+  if ( length < RHDRLEN )
+    return 0;
+  if ( fseek ( rf, (long) off, 0 ) < 0 )
+    return 0;
+  if ( fread ( (char *) & rhrec, sizeof (rhrec), 1, rf ) != 1 )
+    return 0;
+  doff = toulong ( rhrec . rhDataOffset );
+  moff = toulong ( rhrec . rhMapOffset  );
+  dlen = toulong ( rhrec . rhDataLen    );
+  mlen = toulong ( rhrec . rhMapLen     );
+  if ( ( doff < sizeof (rhrec) ) || ( moff < sizeof (rhrec) ) )
+    return 0;
+  if ( ( dlen > length ) || ( doff > length - dlen ) )
+    return 0;
+  if ( ( mlen < sizeof (RsrcMapRec) ) || ( mlen > length ) ||
+       ( moff > length - mlen ) )
+    return 0;
+  return 1;
+}
 
-    /*
-     * Get starting and ending offset columns in bit image.
-     */
-    coff0 = toushort ( & locTable [ ( ( g - fg ) + 0 ) << 1 ] );
-    coff1 = toushort ( & locTable [ ( ( g - fg ) + 1 ) << 1 ] );
-    if ( coff0 == coff1 )
-      continue;
+/*
+ * Locate resource fork in file RF, which may be in MacBinary,
+ * AppleSingle, or AppleDouble format, or may be a raw resource fork
+ * (e.g., a ..namedfork/rsrc dump) or a data fork suitcase (.dfont),
+ * which share the same layout.  Returns non-zero if a resource fork is
+ * found, in which case its offset and length in RF are returned.
+ */
+int
+  FindResourceFork ( rf, ret_offset, ret_length )
+FILE  *	 rf;
+CARD32 * ret_offset;
+CARD32 * ret_length;
+{
+  CARD8	   buf [ 128 ];
+  CARD32   fsize, magic, off, len;
+  int	   n, ne;
 
-    /*
-     * Get basepoint offset and escapement.
-     */
-    ow    = toushort ( & owTable  [ ( g - fg ) << 1 ] );
-    xoff  = ( ( ow >> 8 ) & 0xff ) + mk;
+  if ( fseek ( rf, 0L, 2 ) < 0 )
+    return 0;
+  fsize = (CARD32) ftell ( rf );
+  if ( fseek ( rf, 0L, 0 ) < 0 )
+    return 0;
+  (void) memset ( (char *) buf, 0, sizeof (buf) );
+  if ( fread ( (char *) buf, 1, sizeof (buf), rf ) < sizeof (AppleSingleHdrRec) )
+    return 0;
 
-    /*
-     * Overlay glyph image.
-     */
-    for ( i = 0; i < ht; i++ ) {
-      for ( j = coff0; j < coff1; j++ ) {
-	if ( (int) ( ( j - coff0 ) + xoff ) < 0 )
-	  continue;
-	gp [ i * wd + ( j - coff0 ) + xoff ] |=
-	  ( bp [ i * rw + ( j / 16 ) ] >> ( 15 - ( j % 16 ) ) ) & 1;
-      }
+  /*
+   * AppleSingle and AppleDouble: find resource fork entry.
+   */
+  magic = toulong ( ( (AppleSingleHdr) buf ) -> asMagic );
+  if ( ( magic == ASMAGIC ) || ( magic == ADMAGIC ) ) {
+    ne = toushort ( ( (AppleSingleHdr) buf ) -> asNumEntries );
+    if ( fseek ( rf, (long) sizeof (AppleSingleHdrRec), 0 ) < 0 )
+      return 0;
+    for ( n = 0; n < ne; n++ ) {
+      AppleSingleEntRec ae;
+      if ( fread ( (char *) & ae, sizeof (ae), 1, rf ) != 1 )
+	return 0;
+      if ( toulong ( ae . aeIdent ) != ASRSRCFORK )
+	continue;
+      off = toulong ( ae . aeOffset );
+      len = toulong ( ae . aeLength );
+      if ( ( off > fsize ) || ( len > fsize - off ) )
+	return 0;
+      *ret_offset = off;
+      *ret_length = len;
+      return len != 0;
     }
-
-    ng++;
+    return 0;
   }
 
   /*
-   * Find top and bottom of bounding box.
+   * MacBinary: resource fork follows data fork, padded to 128 bytes.
    */
-  top = ht;
-  bot = 0;
-  for ( i = 0; i < ht; i++ ) {
-    for ( j = 0; j < wd; j++ ) {
-      bit = gp [ i * wd + j ];
-      if ( bit && ( i < top ) )
-	top = i;
-      if ( bit && ( i > bot ) )
-	bot = i;
+  if ( ( buf [ 0 ] == 0 ) && ( buf [ 1 ] >= 1 ) && ( buf [ 1 ] <= 63 ) &&
+       ( buf [ 74 ] == 0 ) && ( buf [ 82 ] == 0 ) ) {
+    len = toulong ( ( (MacBinHdr) buf ) -> fnDataLen );
+    off = 128 + ( ( len + 127 ) & ~127 );
+    len = toulong ( & buf [ 87 ] );
+    if ( ( off <= fsize ) && ( len <= fsize - off ) &&
+	 IsResourceFork ( rf, off, len ) ) {
+      *ret_offset = off;
+      *ret_length = len;
+      return 1;
     }
   }
 
   /*
-   * Find left and right of bounding box.
+   * Raw resource fork or data fork suitcase.
    */
-  left  = wd;
-  right = 0;
-  for ( i = 0; i < ht; i++ ) {
-    for ( j = 0; j < wd; j++ ) {
-      bit = gp [ i * wd + j ];
-      if ( bit && ( j < left ) )
-	left  = j;
-      if ( bit && ( j > right ) )
-	right = j;
-    }
+  if ( IsResourceFork ( rf, 0, fsize ) ) {
+    *ret_offset = 0;
+    *ret_length = fsize;
+    return 1;
   }
+  return 0;
+}
 
-#ifdef notdef
-  if ( ( ( right - left ) + 1 ) != wd )
-    (void) fprintf ( stderr,
-		    "%s: warning: bbox width mismatch, got %d, expected %d\n",
-		    progname, ( right - left ) + 1, wd );
-  if ( ( ( bot - top ) + 1 ) != ht )
-    (void) fprintf ( stderr,
-		    "%s: warning: bbox height mismatch, got %d, expected %d\n",
-		    progname, ( bot - top ) + 1, ht );
-#endif
+/*
+ * Read resource map of resource fork at offset OFF in file RF, and
+ * return it along with the file offset of the fork's resource data.
+ */
+CARD8 *
+  LoadResourceMap ( rf, off, ret_dataoff, ret_maplen )
+FILE  *	 rf;
+CARD32	 off;
+CARD32 * ret_dataoff;
+int *	 ret_maplen;
+{
+  RsrcHdrRec rhrec;
+  CARD32   mlen;
+  CARD8 *  rmap;
 
-  *ret_top    = top;
-  *ret_left   = left + mk;
-  *ret_bottom = bot;
-  *ret_right  = right + mk;
-  *ret_ng     = ng;
+  if ( ( fseek ( rf, (long) off, 0 ) < 0 ) ||
+       ( fread ( (char *) & rhrec, sizeof (rhrec), 1, rf ) != 1 ) ) {
+    (void) fprintf ( stderr, "%s: can't read resource header\n", progname );
+    return (CARD8 *) NULL;
+  }
+  mlen = toulong ( rhrec . rhMapLen );
+  if ( ! ( rmap = (CARD8 *) malloc ( mlen ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: resource map\n", progname );
+    return (CARD8 *) NULL;
+  }
+  if ( ( fseek ( rf, (long) off + toulong ( rhrec . rhMapOffset ), 0 ) < 0 ) ||
+       ( fread ( (char *) rmap, mlen, 1, rf ) != 1 ) ) {
+    (void) fprintf ( stderr, "%s: can't read resource map\n", progname );
+    free ( (char *) rmap );
+    return (CARD8 *) NULL;
+  }
+  if ( ret_dataoff )
+    *ret_dataoff = off + toulong ( rhrec . rhDataOffset );
+  if ( ret_maplen )
+    *ret_maplen  = (int) mlen;
+  return rmap;
 }
 
-char *
-  FontStyleName ( style )
-int style;
+/*
+ * Determine if resource map RMAP contains any FOND, NFNT, or FONT
+ * resources.
+ */
+int
+  ResourceMapHasFonts ( rmap, maplen )
+CARD8 *	 rmap;
+int	 maplen;
 {
-  static char sname [ 128 ];
-  char *retsname;
+  register RsrcType tp, etp;
+  CARD32   typeoff;
 
-  sname [ 0 ] = '\0';
-  if ( style & 0001 )
-    (void) strcat ( sname, "Bold" );
-  if ( style & 0002 )
-    (void) strcat ( sname, "Italic" );
-  if ( style & 0004 )
-    (void) strcat ( sname, "Underlined" );
-  if ( style & 0010 )
-    (void) strcat ( sname, "Outlined" );
-  if ( style & 0020 )
-    (void) strcat ( sname, "Shadowed" );
-  if ( style & 0040 )
-    (void) strcat ( sname, "Condensed" );
-  if ( style & 0100 )
-    (void) strcat ( sname, "Extended" );
+  if ( maplen < (int) sizeof (RsrcMapRec) + 2 )
+    return 0;
+  typeoff = toushort ( ( (RsrcMap) rmap ) -> rmTypeOffset );
+  if ( typeoff + 2 > (CARD32) maplen )
+    return 0;
+  tp  = (RsrcType) & rmap [ typeoff + 2 ];
+  etp = & tp [ toushort ( & rmap [ typeoff ] ) + 1 ];
+  for ( ; tp < etp; tp++ ) {
+    if ( (CARD8 *) & tp [ 1 ] > & rmap [ maplen ] )
+      break;
+    if ( ( memcmp ( (char *) tp->rtName, "FOND", 4 ) == 0 ) ||
+	 ( memcmp ( (char *) tp->rtName, "NFNT", 4 ) == 0 ) ||
+	 ( memcmp ( (char *) tp->rtName, "FONT", 4 ) == 0 ) )
+      return 1;
+  }
+  return 0;
+}
 
-  retsname = (char *) malloc (strlen(sname+1));
-  strcpy(retsname, sname);
-  return retsname;
+/*
+ * Convert HFS+ node name of N UTF-16 units at UP to UTF-8 in NAME.
+ */
+void
+  VolumeUniName ( up, n, name )
+register CARD8 *up;
+int	  n;
+register char *name;
+{
+  register CARD16 u;
+
+  for ( ; n--; up += 2 ) {
+    u = toushort ( up );
+    if ( u < 0x80 )
+      *name++ = (char) u;
+    else if ( u < 0x800 ) {
+      *name++ = (char) ( 0xc0 | ( u >> 6 ) );
+      *name++ = (char) ( 0x80 | ( u & 0x3f ) );
+    } else {
+      *name++ = (char) ( 0xe0 | ( u >> 12 ) );
+      *name++ = (char) ( 0x80 | ( ( u >> 6 ) & 0x3f ) );
+      *name++ = (char) ( 0x80 | ( u & 0x3f ) );
+    }
+  }
+  *name = '\0';
 }
 
-int
-  FontDump ( fp, name, style, size )
-FontRsrc fp;
-char *	 name;
-int	 style;
-int	 size;
+/*
+ * Map offset OFF in a fork with NEXT extents EXT into an offset in the
+ * volume image, also returning the number of contiguous bytes there.
+ * Returns -1 if OFF lies beyond the extents.
+ */
+long
+  VolumeForkOffset ( vp, ext, next, off, ret_avail )
+Volume	  vp;
+VolExtent ext;
+int	  next;
+CARD32	  off;
+CARD32 *  ret_avail;
 {
-  register int i, j, bit, bits;
-  register CARD16 *bp;
-  register CARD8  *gp;
-  CARD16   g, fg, lg, coff0, coff1, ow, wo;
-  INT16    mk, wd, ht, rw, top, bot, left, right, ng;
-  CARD8 *  bitImage;
-  CARD8 *  locTable;
-  CARD8 *  owTable;
-  FILE *   fout;
-  char 	   fname [ 128 ];
+  register int n;
+  CARD32   len;
 
-  if ( ! fp || ! name || ! size )
-    return 1;
+  for ( n = 0; n < next; n++ ) {
+    len = ext [ n ] . count * vp->blksize;
+    if ( off < len ) {
+      if ( ret_avail )
+	*ret_avail = len - off;
+      return vp->base + (long) ext [ n ] . start * vp->blksize + off;
+    }
+    off -= len;
+  }
+  return -1;
+}
 
-  fg = toushort ( fp->ftFirstChar   );
-  lg = toushort ( fp->ftLastChar    );
-  mk = toshort  ( fp->ftKernMax     );
-  wd = toshort  ( fp->ftFRectWidth  );
-  ht = toshort  ( fp->ftFRectHeight );
-  wo = toushort ( fp->ftOWTLoc      );
-  rw = toshort  ( fp->ftRowWords    );
+/*
+ * Read LEN bytes at offset OFF in a fork with NEXT extents EXT.
+ */
+int
+  VolumeRead ( vp, ext, next, off, buf, len )
+Volume	  vp;
+VolExtent ext;
+int	  next;
+CARD32	  off;
+CARD8 *	  buf;
+CARD32	  len;
+{
+  CARD32   avail, n;
+  long	   ioff;
 
-  bitImage = (CARD8 *) & fp [ 1 ];
-  locTable = & bitImage     [ ( rw * ht ) << 1 ];
-#ifdef notdef
-  owTable  = & fp->ftOWTLoc [ wo          << 1     ];
-#else
-  owTable  = & locTable     [ ( lg - fg + 3 ) << 1 ];
-#endif
+  while ( len > 0 ) {
+    if ( ( ioff = VolumeForkOffset ( vp, ext, next, off, & avail ) ) < 0 )
+      return 0;
+    n = ( avail < len ) ? avail : len;
+    if ( ( fseek ( vp->vf, ioff, 0 ) < 0 ) ||
+	 ( fread ( (char *) buf, n, 1, vp->vf ) != 1 ) )
+      return 0;
+    buf += n;
+    off += n;
+    len -= n;
+  }
+  return 1;
+}
 
-  /*
+/*
+ * Decode NE extent descriptors at EP into EXT, where each descriptor is
+ * a pair of 16-bit (HFS) or 32-bit (HFS+) block numbers.  Returns the
+ * number of extents in use and their total number of blocks.
+ */
+int
+  VolumeExtents ( plus, ep, ne, ext, ret_blocks )
+int	  plus;
+CARD8 *	  ep;
+int	  ne;
+VolExtent ext;
+CARD32 *  ret_blocks;
+{
+  register int n;
+  CARD32   blocks = 0;
+
+  for ( n = 0; n < ne; n++ ) {
+    if ( plus ) {
+      ext [ n ] . start = toulong  ( & ep [ n * 8 + 0 ] );
+      ext [ n ] . count = toulong  ( & ep [ n * 8 + 4 ] );
+    } else {
+      ext [ n ] . start = toushort ( & ep [ n * 4 + 0 ] );
+      ext [ n ] . count = toushort ( & ep [ n * 4 + 2 ] );
+    }
+    if ( ! ext [ n ] . count )
+      break;
+    blocks += ext [ n ] . count;
+  }
+  if ( ret_blocks )
+    *ret_blocks = blocks;
+  return n;
+}
+
+/*
+ * Open HFS or HFS+ volume at offset VOFF in image VF.  An HFS wrapper
+ * around an embedded HFS+ volume is followed to the latter.
+ */
+int
+  VolumeOpen ( vp, vf, voff )
+Volume	  vp;
+FILE *	  vf;
+long	  voff;
+{
+  CARD8	   buf [ 512 ];
+  HfsMdb   mdb = (HfsMdb) buf;
+  HfsPlusVolHdr vh = (HfsPlusVolHdr) buf;
+  CARD32   blocks;
+
+  if ( ( fseek ( vf, voff + VHDROFFSET, 0 ) < 0 ) ||
+       ( fread ( (char *) buf, sizeof (buf), 1, vf ) != 1 ) )
+    return 0;
+
+  vp->vf = vf;
+  switch ( toushort ( buf ) ) {
+  case HFSSIGNATURE:
+    vp->blksize = toulong ( mdb->drAlBlkSiz );
+    vp->base    = voff + (long) toushort ( mdb->drAlBlSt ) * 512;
+    if ( ! vp->blksize || ( vp->blksize & 511 ) )
+      return 0;
+    if ( toushort ( mdb->drEmbedSigWord ) == HFSPSIGNATURE )
+      return VolumeOpen ( vp, vf, vp->base + (long)
+			  toushort ( & mdb->drEmbedExtent [ 0 ] ) *
+			  vp->blksize );
+    vp->plus    = 0;
+    vp->ncatext = VolumeExtents ( 0, mdb->drCTExtRec, 3, vp->catext,
+				  & blocks );
+    if ( (unsigned long) blocks * vp->blksize < toulong ( mdb->drCTFlSize ) )
+      (void) fprintf ( stderr, "%s: warning: catalog extents overflow\n",
+		       progname );
+    return vp->ncatext > 0;
+  case HFSPSIGNATURE:
+  case HFSXSIGNATURE:
+    vp->blksize = toulong ( vh->vhBlockSize );
+    vp->base    = voff;
+    if ( ! vp->blksize || ( vp->blksize & 511 ) )
+      return 0;
+    vp->plus    = 1;
+    vp->ncatext = VolumeExtents ( 1, vh->vhCatalogFile . fkExtents,
+				  MAXEXTENTS, vp->catext, & blocks );
+    if ( blocks < toulong ( vh->vhCatalogFile . fkTotalBlocks ) )
+      (void) fprintf ( stderr, "%s: warning: catalog extents overflow\n",
+		       progname );
+    return vp->ncatext > 0;
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Pass resource fork of file NAME, of LEN bytes in NEXT extents EXT, to
+ * FN if it contains font resources.  A contiguous fork is read straight
+ * from the image; a fragmented one is gathered into a temporary file
+ * first.
+ */
+int
+  VolumeFork ( vp, name, ext, next, len, fn )
+Volume	  vp;
+char *	  name;
+VolExtent ext;
+int	  next;
+CARD32	  len;
+int	( * fn ) ();
+{
+  FILE *   rf;
+  FILE *   tf = (FILE *) NULL;
+  CARD8 *  buf;
+  CARD8 *  rmap;
+  CARD32   avail, dataoff;
+  long	   off;
+  int	   maplen, ret = 1;
+
+  if ( ( off = VolumeForkOffset ( vp, ext, next, 0, & avail ) ) < 0 )
+    return 1;
+  if ( avail >= len )
+    rf = vp->vf;
+  else {
+    if ( ! ( buf = (CARD8 *) malloc ( len ) ) ) {
+      (void) fprintf ( stderr, "%s: out of memory: fork of \"%s\"\n",
+		       progname, name );
+      return 1;
+    }
+    if ( ! VolumeRead ( vp, ext, next, 0, buf, len ) ||
+	 ! ( tf = tmpfile () ) ||
+	 ( fwrite ( (char *) buf, 1, len, tf ) != len ) ||
+	 ( fflush ( tf ) != 0 ) ) {
+      (void) fprintf ( stderr, "%s: can't read fork of \"%s\"\n",
+		       progname, name );
+      if ( tf )
+	(void) fclose ( tf );
+      free ( (char *) buf );
+      return 1;
+    }
+    free ( (char *) buf );
+    rf	= tf;
+    off = 0;
+  }
+
+  if ( IsResourceFork ( rf, (CARD32) off, len ) &&
+       ( rmap = LoadResourceMap ( rf, (CARD32) off, & dataoff, & maplen ) ) ) {
+    if ( ResourceMapHasFonts ( rmap, maplen ) )
+      ret = ( *fn ) ( name, rf, dataoff, rmap );
+    free ( (char *) rmap );
+  }
+
+  if ( tf )
+    (void) fclose ( tf );
+  return ret;
+}
+
+/*
+ * Walk catalog B-tree leaf nodes of volume VP, passing the resource fork
+ * of each file containing font resources to FN.
+ */
+int
+  VolumeWalk ( vp, fn )
+Volume	  vp;
+int	( * fn ) ();
+{
+  CARD8	   hdr [ 512 ];
+  CARD8 *  node;
+  CARD8 *  rp;
+  CARD32   nsize, nnodes, nd, visited, rlen, blocks;
+  BTHdr	   bh = (BTHdr) & hdr [ sizeof (BTNodeDescRec) ];
+  HfsPlusFork fk;
+  VolExtentRec ext [ MAXEXTENTS ];
+  char	   name [ 768 ];
+  int	   n, nr, ne, ko, klen, c, ret = 1;
+
+  if ( ! VolumeRead ( vp, vp->catext, vp->ncatext, 0, hdr, sizeof (hdr) ) )
+    return 0;
+  nsize  = toushort ( bh->bthNodeSize );
+  nnodes = toulong  ( bh->bthNNodes );
+  nd     = toulong  ( bh->bthFNode  );
+  if ( ( nsize < 512 ) || ( nsize & 511 ) )
+    return 0;
+  if ( ! ( node = (CARD8 *) malloc ( nsize ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: catalog node\n", progname );
+    return 0;
+  }
+
+  for ( visited = 0; nd && ( visited < nnodes ); visited++ ) {
+    if ( ! VolumeRead ( vp, vp->catext, vp->ncatext, nd * nsize,
+			node, nsize ) ) {
+      (void) fprintf ( stderr, "%s: can't read catalog node %lu\n",
+		       progname, (unsigned long) nd );
+      ret = 0;
+      break;
+    }
+    if ( ( (BTNodeDesc) node ) -> ndType [ 0 ] != 0xff )
+      break;
+    nr = toushort ( ( (BTNodeDesc) node ) -> ndNRecs );
+    for ( n = 0; n < nr; n++ ) {
+      ko = toushort ( & node [ nsize - ( ( n + 1 ) << 1 ) ] );
+      if ( ko + 8 > (int) nsize )
+	continue;
+
+      /*
+       * Decode key's node name and locate file record, if any.
+       */
+      if ( vp->plus ) {
+	klen = toushort ( & node [ ko ] );
+	rp   = & node [ ko + 2 + klen ];
+	c    = toushort ( & node [ ko + 6 ] );
+	if ( ( rp + sizeof (HfsPlusCatFileRec) > & node [ nsize ] ) ||
+	     ( toushort ( rp ) != 2 ) || ( c > 255 ) ||
+	     ( 6 + 2 * c > klen ) )
+	  continue;
+	VolumeUniName ( & node [ ko + 8 ], c, name );
+	fk   = & ( (HfsPlusCatFile) rp ) -> pfRsrcFork;
+	rlen = toulong ( & fk->fkLogicalSize [ 4 ] );
+	if ( ! rlen || toulong ( & fk->fkLogicalSize [ 0 ] ) )
+	  continue;
+	ne = VolumeExtents ( 1, fk->fkExtents, MAXEXTENTS, ext, & blocks );
+      } else {
+	klen = node [ ko ];
+	rp   = & node [ ( ko + 1 + klen + 1 ) & ~1 ];
+	c    = node [ ko + 6 ];
+	if ( ( rp + sizeof (HfsCatFileRec) > & node [ nsize ] ) ||
+	     ( rp [ 0 ] != 2 ) || ( c > 31 ) || ( 6 + c > klen ) )
+	  continue;
+	(void) memcpy ( name, (char *) & node [ ko + 7 ], c );
+	name [ c ] = '\0';
+	rlen = toulong ( ( (HfsCatFile) rp ) -> filRLgLen );
+	if ( ! rlen )
+	  continue;
+	ne = VolumeExtents ( 0, ( (HfsCatFile) rp ) -> filRExtRec, 3,
+			     ext, & blocks );
+      }
+
+      if ( (unsigned long) blocks * vp->blksize < rlen ) {
+	(void) fprintf ( stderr,
+			 "%s: warning: fork of \"%s\" overflows extents, skipped\n",
+			 progname, name );
+	continue;
+      }
+      if ( ! VolumeFork ( vp, name, ext, ne, rlen, fn ) )
+	ret = 0;
+    }
+    nd = toulong ( ( (BTNodeDesc) node ) -> ndFLink );
+  }
+
+  free ( (char *) node );
+  return ret;
+}
+
+/*
+ * Walk every HFS or HFS+ volume in disk image VF, whether a bare volume,
+ * a DiskCopy 4.2 image, or a partitioned image with an Apple partition
+ * map, passing each font resource fork to FN as ( name, rf, dataoff,
+ * rmap ), i.e., as the resource loader expects.  Returns the number of
+ * volumes found, or -1 on error.
+ */
+int
+  ImageWalk ( vf, fn )
+FILE *	  vf;
+int	( * fn ) ();
+{
+  VolumeRec vol;
+  CARD8	   buf [ 512 ];
+  CARD32   bsize, nmap, n;
+  int	   nv = 0, ok = 1;
+
+  if ( ( fseek ( vf, 0L, 0 ) < 0 ) ||
+       ( fread ( (char *) buf, sizeof (buf), 1, vf ) != 1 ) )
+    return -1;
+
+  /*
+   * Partitioned image: walk each HFS partition.
+   */
+  if ( toushort ( buf ) == DDRSIGNATURE ) {
+    bsize = toushort ( & buf [ 2 ] );
+    if ( ! bsize )
+      bsize = 512;
+    for ( n = 1, nmap = 1; n <= nmap; n++ ) {
+      PartMap pm = (PartMap) buf;
+      if ( ( fseek ( vf, (long) n * bsize, 0 ) < 0 ) ||
+	   ( fread ( (char *) buf, sizeof (buf), 1, vf ) != 1 ) ||
+	   ( toushort ( pm->pmSig ) != PMSIGNATURE ) )
+	break;
+      nmap = toulong ( pm->pmMapBlkCnt );
+      if ( strncmp ( (char *) pm->pmParType, "Apple_HFS", 32 ) != 0 )
+	continue;
+      if ( VolumeOpen ( & vol, vf,
+			(long) toulong ( pm->pmPyPartStart ) * bsize ) ) {
+	nv++;
+	ok &= VolumeWalk ( & vol, fn );
+      }
+    }
+    return ok ? nv : -1;
+  }
+
+  /*
+   * Bare volume, or DiskCopy 4.2 floppy image.
+   */
+  if ( VolumeOpen ( & vol, vf, 0L ) ||
+       VolumeOpen ( & vol, vf, (long) DC42HDRLEN ) ) {
+    nv++;
+    ok &= VolumeWalk ( & vol, fn );
+  }
+  return ok ? nv : -1;
+}
+
+/*
+ * Determine if resource data is in Apple's compressed resource format.
+ */
+int
+  ResourceCompressed ( bp, length )
+CARD8 *	 bp;
+int	 length;
+{
+  register CmpRsrcHdr ch = (CmpRsrcHdr) bp;
+
+  if ( length < (int) sizeof (CmpRsrcHdrRec) )
+    return 0;
+  if ( toulong ( ch->chSignature ) != CMPSIGNATURE )
+    return 0;
+  return ( ch->chAttr [ 0 ] & 0x01 ) != 0;
+}
+
+/*
+ * Decompress 'dcmp' (2) data in [IP,IE) into ULEN bytes at OP.  The
+ * data is a sequence of byte indices into a table of words, which, in
+ * the tagged form, is interleaved with tag bytes whose clear bits (MSB
+ * first) denote literal words instead.  An odd final byte is stored
+ * literally at the end of the data.  The table is assumed to precede
+ * the data, i.e., only custom table resources are handled.
+ */
+int
+  Dcmp2 ( ip, ie, op, ulen, params )
+register CARD8 *ip;
+CARD8 *	 ie;
+register CARD8 *op;
+CARD32	 ulen;
+CARD8 *	 params;
+{
+  register CARD8 *tp;
+  register int tag, n;
+  CARD8 *  oe;
+  int	   nt;
+
+  nt = params [ 2 ] + 1;
+  tp = ip;
+  ip = & ip [ nt << 1 ];
+  oe = & op [ ulen & ~1 ];
+  if ( ip > ie )
+    return 0;
+
+  if ( params [ 3 ] & 0x02 ) {
+    while ( op < oe ) {
+      if ( ip >= ie )
+	return 0;
+      tag = *ip++;
+      for ( n = 0; ( n < 8 ) && ( op < oe ); n++, tag <<= 1, op += 2 ) {
+	if ( tag & 0x80 ) {
+	  if ( ( ip >= ie ) || ( *ip >= nt ) )
+	    return 0;
+	  op [ 0 ] = tp [ ( *ip << 1 ) + 0 ];
+	  op [ 1 ] = tp [ ( *ip << 1 ) + 1 ];
+	  ip++;
+	} else {
+	  if ( ( ip + 2 ) > ie )
+	    return 0;
+	  op [ 0 ] = *ip++;
+	  op [ 1 ] = *ip++;
+	}
+      }
+    }
+  } else {
+    for ( ; op < oe; op += 2, ip++ ) {
+      if ( ( ip >= ie ) || ( *ip >= nt ) )
+	return 0;
+      op [ 0 ] = tp [ ( *ip << 1 ) + 0 ];
+      op [ 1 ] = tp [ ( *ip << 1 ) + 1 ];
+    }
+  }
+
+  if ( ulen & 1 ) {
+    if ( ip >= ie )
+      return 0;
+    *op = ie [ -1 ];
+  }
+  return 1;
+}
+
+/*
+ * Transparently decompress data BP of LENGTH bytes of resource TYPE,
+ * RID, which is returned as is if not compressed.  Otherwise, a new
+ * buffer holding the decompressed data is returned, in which case the
+ * caller is to free the original.  Returns NULL if the data can't be
+ * decompressed, and the resource is to be skipped.
+ */
+CARD8 *
+  DecompressResource ( bp, length, type, rid, ret_length )
+CARD8 *	 bp;
+int	 length;
+CARD8 *	 type;
+int	 rid;
+int *	 ret_length;
+{
+  register CmpRsrcHdr ch = (CmpRsrcHdr) bp;
+  CARD32   ulen;
+  CARD8 *  ubp;
+  int	   hlen, id;
+
+  if ( ! ResourceCompressed ( bp, length ) ) {
+    if ( ret_length )
+      *ret_length = length;
+    return bp;
+  }
+
+  hlen = toushort ( ch->chHdrLen );
+  ulen = toulong  ( ch->chLength );
+  switch ( ch->chVersion [ 0 ] ) {
+  case 8:
+    id = toshort ( & ch->chParams [ 2 ] );
+    break;
+  case 9:
+    id = toshort ( & ch->chParams [ 0 ] );
+    break;
+  default:
+    id = -1;
+    break;
+  }
+
+  /*
+   * The 'dcmp' (0) and (1) decompressors and the default 'dcmp' (2)
+   * table are code and data in the System file, and aren't reproduced
+   * here; skip these rather than hand back garbage.
+   */
+  if ( ( ch->chVersion [ 0 ] != 9 ) || ( id != 2 ) ) {
+    (void) fprintf ( stderr,
+		     "%s: warning: skipping '%.4s' %d, compressed with unsupported 'dcmp' (%d), header version %d\n",
+		     progname, (char *) type, rid, id, ch->chVersion [ 0 ] );
+    return (CARD8 *) NULL;
+  }
+  if ( ! ( ch->chParams [ 5 ] & 0x01 ) ) {
+    (void) fprintf ( stderr,
+		     "%s: warning: skipping '%.4s' %d, compressed with the unsupported default 'dcmp' (2) table\n",
+		     progname, (char *) type, rid );
+    return (CARD8 *) NULL;
+  }
+  if ( ( hlen < (int) sizeof (CmpRsrcHdrRec) ) || ( hlen > length ) ||
+       ( ulen > 0x7fffffff ) ) {
+    (void) fprintf ( stderr,
+		     "%s: warning: skipping '%.4s' %d, bad compressed resource header\n",
+		     progname, (char *) type, rid );
+    return (CARD8 *) NULL;
+  }
+
+  if ( ! ( ubp = (CARD8 *) malloc ( ulen ? ulen : 1 ) ) ) {
+    (void) fprintf ( stderr, "%s: memory request failed, %lu bytes\n",
+		     progname, (unsigned long) ulen );
+    return (CARD8 *) NULL;
+  }
+  if ( ! Dcmp2 ( & bp [ hlen ], & bp [ length ], ubp, ulen,
+		 & ch->chParams [ 2 ] ) ) {
+    (void) fprintf ( stderr,
+		     "%s: warning: skipping '%.4s' %d, corrupt compressed resource\n",
+		     progname, (char *) type, rid );
+    free ( (char *) ubp );
+    return (CARD8 *) NULL;
+  }
+
+  if ( ret_length )
+    *ret_length = (int) ulen;
+  return ubp;
+}
+
+/*
+ * Read the data of resource TYPE, ID at offset RDOFF in the resource data
+ * at file offset DOFF of file RF, decompressing it if it is compressed.
+ * Returns a buffer to be released with FreeResource, or NULL if the data
+ * can't be read or decompressed.
+ */
+CARD8 *
+  _LoadResource ( rf, doff, rdoff, type, id, ret_length )
+FILE  *	 rf;
+CARD32	 doff;
+CARD32	 rdoff;
+CARD8 *	 type;
+int	 id;
+int *	 ret_length;
+{
+  CARD8	   buf [ 4 ];
+  CARD8 *  bp;
+  CARD8 *  ubp;
+  CARD32   rdlen;
+  int	   ulen;
+
+  if ( fseek ( rf, (long) doff + rdoff, 0 ) < 0 ) {
+    (void) fprintf ( stderr, "%s: resource seek error, offset %lu\n",
+		     progname, (unsigned long) doff + rdoff );
+    return (CARD8 *) NULL;
+  }
+  if ( fread ( (char *) buf, sizeof (buf), 1, rf ) != 1 ) {
+    (void) fprintf ( stderr, "%s: resource length read error\n", progname );
+    return (CARD8 *) NULL;
+  }
+  rdlen = toulong ( buf );
+  if ( ( rdlen > 0x7fffffff ) ||
+       ! ( bp = (CARD8 *) malloc ( rdlen ? rdlen : 1 ) ) ) {
+    (void) fprintf ( stderr, "%s: memory request failed, %lu bytes\n",
+		     progname, (unsigned long) rdlen );
+    return (CARD8 *) NULL;
+  }
+  if ( rdlen && ( fread ( (char *) bp, rdlen, 1, rf ) != 1 ) ) {
+    (void) fprintf ( stderr, "%s: resource read error\n", progname );
+    free ( (char *) bp );
+    return (CARD8 *) NULL;
+  }
+
+  if ( ! ( ubp = DecompressResource ( bp, (int) rdlen, type, id, & ulen ) ) ) {
+    free ( (char *) bp );
+    return (CARD8 *) NULL;
+  }
+  if ( ubp != bp )
+    free ( (char *) bp );
+  if ( ret_length )
+    *ret_length = ulen;
+  return ubp;
+}
+
+/*
+ * Load resource TYPE, ID from the resource fork of file RF whose map,
+ * of MAPLEN bytes, is RMAP and whose resource data is at file offset
+ * DOFF.  Compressed resources are expanded.  Returns NULL if there is
+ * no such resource or it can't be loaded.
+ */
+CARD8 *
+  LoadResource ( rf, doff, rmap, maplen, type, id, ret_length )
+FILE  *	 rf;
+CARD32	 doff;
+CARD8 *	 rmap;
+int	 maplen;
+char *	 type;
+int	 id;
+int *	 ret_length;
+{
+  register RsrcType tp, etp;
+  register RsrcRef  rp, erp;
+  CARD32   typeoff, refoff;
+  CARD8	   buf [ 4 ];
+
+  if ( maplen < (int) sizeof (RsrcMapRec) + 2 )
+    return (CARD8 *) NULL;
+  typeoff = toushort ( ( (RsrcMap) rmap ) -> rmTypeOffset );
+  if ( typeoff + 2 > (CARD32) maplen )
+    return (CARD8 *) NULL;
+  tp  = (RsrcType) & rmap [ typeoff + 2 ];
+  etp = & tp [ toushort ( & rmap [ typeoff ] ) + 1 ];
+  for ( ; tp < etp; tp++ ) {
+    if ( (CARD8 *) & tp [ 1 ] > & rmap [ maplen ] )
+      break;
+    if ( memcmp ( (char *) tp->rtName, type, 4 ) != 0 )
+      continue;
+    refoff = typeoff + toushort ( tp->rtRefOffset );
+    rp	= (RsrcRef) & rmap [ refoff ];
+    erp = & rp [ toushort ( tp->rtCount ) + 1 ];
+    for ( ; rp < erp; rp++ ) {
+      if ( (CARD8 *) & rp [ 1 ] > & rmap [ maplen ] )
+	break;
+      if ( (int) toshort ( rp->rrIdent ) != id )
+	continue;
+      (void) memcpy ( (char *) buf, (char *) rp->rrAttr, sizeof (buf) );
+      buf [ 0 ] = 0;
+      return _LoadResource ( rf, doff, toulong ( buf ), tp->rtName, id,
+			     ret_length );
+    }
+  }
+  return (CARD8 *) NULL;
+}
+
+/*
+ * Release resource data RP of LENGTH bytes returned by LoadResource.
+ */
+/*ARGSUSED*/
+void
+  FreeResource ( rp, length )
+CARD8 *	 rp;
+int	 length;
+{
+  if ( rp )
+    free ( (char *) rp );
+}
+
+int
+  KernelScalarSupported ()
+{
+  return 1;
+}
+
+/*
+ * Extract all HT rows of a glyph of columns COFF0 up to COFF1, of any
+ * width, from strike SP of RB byte rows, as packed rows at OP.  Each
+ * packed byte merges two strike bytes shifted by the glyph's bit offset;
+ * the last fetch of a row may be the first byte of the next row, or of
+ * the tables after the strike, and is masked off.
+ */
+void
+  KernelScalarExtract ( sp, rb, coff0, coff1, ht, op )
+register CARD8 * sp;
+int		 rb;
+int		 coff0;
+int		 coff1;
+int		 ht;
+register CARD8 * op;
+{
+  register int	i, k, nb, sh;
+  CARD8	   mask;
+
+  nb   = ( ( coff1 - coff0 ) + 7 ) >> 3;
+  sh   = coff0 & 7;
+  mask = 0xff << ( ( 8 - ( ( coff1 - coff0 ) & 7 ) ) & 7 );
+  sp  += coff0 >> 3;
+  for ( i = 0; i < ht; i++, sp += rb, op += nb ) {
+    for ( k = 0; k < nb; k++ )
+      op [ k ] = ( ( sp [ k ] << 8 | sp [ k + 1 ] ) << sh ) >> 8;
+    op [ nb - 1 ] &= mask;
+  }
+}
+
+/*
+ * Unpack all HT rows of a glyph of pixels COFF0 up to COFF1 from strike
+ * SP of RB byte rows, DEPTH bits per pixel, to a byte per pixel value at
+ * OP.
+ */
+void
+  KernelScalarGray ( sp, rb, coff0, coff1, ht, depth, op )
+register CARD8 * sp;
+int		 rb;
+int		 coff0;
+int		 coff1;
+int		 ht;
+int		 depth;
+register CARD8 * op;
+{
+  register int	i, j, b;
+  CARD8	   mask;
+
+  mask = ( 1 << depth ) - 1;
+  for ( i = 0; i < ht; i++, sp += rb )
+    for ( j = coff0; j < coff1; j++ ) {
+      b = j * depth;
+      *op++ = ( sp [ b >> 3 ] >> ( 8 - depth - ( b & 7 ) ) ) & mask;
+    }
+}
+
+/*
+ * Encode the NB bytes at IP as a line of lowercase hex digits, as by
+ * "%02x", into OP.  Returns the line length, including the newline.
+ * Vector tiers may read up to 15 bytes past the row and write up to 31
+ * bytes past the line.
+ */
+int
+  KernelScalarHexRow ( ip, nb, op )
+register CARD8 * ip;
+int		 nb;
+register char *	 op;
+{
+  register int	j;
+
+  for ( j = 0; j < nb; j++ ) {
+    *op++ = "0123456789abcdef" [ ip [ j ] >> 4	];
+    *op++ = "0123456789abcdef" [ ip [ j ] & 0xf ];
+  }
+  *op = '\n';
+  return ( nb << 1 ) + 1;
+}
+
+#ifdef X86KERNELS
+
+int
+  KernelSSE2Supported ()
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ( "sse2" );
+}
+
+/*
+ * Sixteen packed bytes at a time: interleave each strike byte with the
+ * next into a 16-bit lane, shift the lane by the bit offset and keep its
+ * high byte.
+ */
+__attribute__ ((target ("sse2")))
+void
+  KernelSSE2Extract ( sp, rb, coff0, coff1, ht, op )
+register CARD8 * sp;
+int		 rb;
+int		 coff0;
+int		 coff1;
+int		 ht;
+register CARD8 * op;
+{
+  register int	i, k, nb, sh;
+  CARD8	   mask;
+  __m128i  x, y, lo, hi, count;
+
+  nb	= ( ( coff1 - coff0 ) + 7 ) >> 3;
+  sh	= coff0 & 7;
+  mask	= 0xff << ( ( 8 - ( ( coff1 - coff0 ) & 7 ) ) & 7 );
+  count = _mm_cvtsi32_si128 ( sh );
+  sp   += coff0 >> 3;
+  for ( i = 0; i < ht; i++, sp += rb, op += nb ) {
+    for ( k = 0; k + 16 <= nb; k += 16 ) {
+      x	 = _mm_loadu_si128 ( (__m128i *) & sp [ k ] );
+      y	 = _mm_loadu_si128 ( (__m128i *) & sp [ k + 1 ] );
+      lo = _mm_srli_epi16 ( _mm_sll_epi16 ( _mm_unpacklo_epi8 ( y, x ),
+					    count ), 8 );
+      hi = _mm_srli_epi16 ( _mm_sll_epi16 ( _mm_unpackhi_epi8 ( y, x ),
+					    count ), 8 );
+      _mm_storeu_si128 ( (__m128i *) & op [ k ], _mm_packus_epi16 ( lo, hi ) );
+    }
+    for ( ; k < nb; k++ )
+      op [ k ] = ( ( sp [ k ] << 8 | sp [ k + 1 ] ) << sh ) >> 8;
+    op [ nb - 1 ] &= mask;
+  }
+}
+
+/*
+ * Sixteen strike bytes at a time: split each byte into its high and low
+ * nibbles, interleaved in pixel order, and for 2-bit pixels split each
+ * nibble the same way again.  Whole bytes are unpacked to a row of TP,
+ * from which the glyph's pixels are copied.
+ */
+__attribute__ ((target ("sse2")))
+void
+  KernelSSE2Gray ( sp, rb, coff0, coff1, ht, depth, op )
+register CARD8 * sp;
+int		 rb;
+int		 coff0;
+int		 coff1;
+int		 ht;
+int		 depth;
+register CARD8 * op;
+{
+  register int	i, k, b;
+  int	   ppb, b0, nbytes, lead, w;
+  CARD8 *  tp;
+  __m128i  in, hi, lo, n0, n1, low2, low4;
+
+  if ( depth == 8 ) {
+    for ( i = 0; i < ht; i++, sp += rb, op += coff1 - coff0 )
+      (void) memcpy ( (char *) op, (char *) & sp [ coff0 ], coff1 - coff0 );
+    return;
+  }
+
+  ppb	 = 8 / depth;
+  b0	 = ( coff0 * depth ) >> 3;
+  nbytes = ( ( coff1 * depth + 7 ) >> 3 ) - b0;
+  lead	 = coff0 - b0 * ppb;
+  w	 = coff1 - coff0;
+  tp	 = (CARD8 *) alloca ( nbytes * ppb );
+  low2	 = _mm_set1_epi8 ( 0x03 );
+  low4	 = _mm_set1_epi8 ( 0x0f );
+  for ( i = 0, sp += b0; i < ht; i++, sp += rb, op += w ) {
+    for ( k = 0; k + 16 <= nbytes; k += 16 ) {
+      in = _mm_loadu_si128 ( (__m128i *) & sp [ k ] );
+      hi = _mm_and_si128 ( _mm_srli_epi16 ( in, 4 ), low4 );
+      lo = _mm_and_si128 ( in, low4 );
+      n0 = _mm_unpacklo_epi8 ( hi, lo );
+      n1 = _mm_unpackhi_epi8 ( hi, lo );
+      if ( depth == 4 ) {
+	_mm_storeu_si128 ( (__m128i *) & tp [ ( k << 1 ) +  0 ], n0 );
+	_mm_storeu_si128 ( (__m128i *) & tp [ ( k << 1 ) + 16 ], n1 );
+	continue;
+      }
+      hi = _mm_and_si128 ( _mm_srli_epi16 ( n0, 2 ), low2 );
+      lo = _mm_and_si128 ( n0, low2 );
+      _mm_storeu_si128 ( (__m128i *) & tp [ ( k << 2 ) +  0 ],
+			 _mm_unpacklo_epi8 ( hi, lo ) );
+      _mm_storeu_si128 ( (__m128i *) & tp [ ( k << 2 ) + 16 ],
+			 _mm_unpackhi_epi8 ( hi, lo ) );
+      hi = _mm_and_si128 ( _mm_srli_epi16 ( n1, 2 ), low2 );
+      lo = _mm_and_si128 ( n1, low2 );
+      _mm_storeu_si128 ( (__m128i *) & tp [ ( k << 2 ) + 32 ],
+			 _mm_unpacklo_epi8 ( hi, lo ) );
+      _mm_storeu_si128 ( (__m128i *) & tp [ ( k << 2 ) + 48 ],
+			 _mm_unpackhi_epi8 ( hi, lo ) );
+    }
+    for ( k *= ppb; k < nbytes * ppb; k++ ) {
+      b = k * depth;
+      tp [ k ] = ( sp [ b >> 3 ] >> ( 8 - depth - ( b & 7 ) ) ) &
+	( ( 1 << depth ) - 1 );
+    }
+    (void) memcpy ( (char *) op, (char *) & tp [ lead ], w );
+  }
+}
+
+/*
+ * Digits are nibble + '0', plus 'a' - '0' - 10 for nibbles above 9.
+ */
+__attribute__ ((target ("sse2")))
+int
+  KernelSSE2HexRow ( ip, nb, op )
+register CARD8 * ip;
+int		 nb;
+register char *	 op;
+{
+  register int	j;
+  __m128i  in, hi, lo, low4, nine, zero, alpha;
+
+  low4	= _mm_set1_epi8 ( 0x0f );
+  nine	= _mm_set1_epi8 ( 9 );
+  zero	= _mm_set1_epi8 ( '0' );
+  alpha = _mm_set1_epi8 ( 'a' - '0' - 10 );
+  for ( j = 0; j < nb; j += 16 ) {
+    in = _mm_loadu_si128 ( (__m128i *) & ip [ j ] );
+    hi = _mm_and_si128 ( _mm_srli_epi16 ( in, 4 ), low4 );
+    lo = _mm_and_si128 ( in, low4 );
+    hi = _mm_add_epi8 ( _mm_add_epi8 ( hi, zero ),
+			_mm_and_si128 ( _mm_cmpgt_epi8 ( hi, nine ), alpha ) );
+    lo = _mm_add_epi8 ( _mm_add_epi8 ( lo, zero ),
+			_mm_and_si128 ( _mm_cmpgt_epi8 ( lo, nine ), alpha ) );
+    _mm_storeu_si128 ( (__m128i *) & op [ ( j << 1 ) +	0 ],
+		       _mm_unpacklo_epi8 ( hi, lo ) );
+    _mm_storeu_si128 ( (__m128i *) & op [ ( j << 1 ) + 16 ],
+		       _mm_unpackhi_epi8 ( hi, lo ) );
+  }
+  op [ nb << 1 ] = '\n';
+  return ( nb << 1 ) + 1;
+}
+
+int
+  KernelAVX2Supported ()
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ( "avx2" );
+}
+
+/*
+ * As the SSE2 tier, 32 packed bytes at a time; unpacking and packing
+ * both work within 128-bit halves, so the bytes come out in order.
+ */
+__attribute__ ((target ("avx2")))
+void
+  KernelAVX2Extract ( sp, rb, coff0, coff1, ht, op )
+register CARD8 * sp;
+int		 rb;
+int		 coff0;
+int		 coff1;
+int		 ht;
+register CARD8 * op;
+{
+  register int	i, k, nb, sh;
+  CARD8	   mask;
+  __m128i  count;
+  __m256i  x, y, lo, hi;
+
+  nb	= ( ( coff1 - coff0 ) + 7 ) >> 3;
+  sh	= coff0 & 7;
+  mask	= 0xff << ( ( 8 - ( ( coff1 - coff0 ) & 7 ) ) & 7 );
+  count = _mm_cvtsi32_si128 ( sh );
+  sp   += coff0 >> 3;
+  for ( i = 0; i < ht; i++, sp += rb, op += nb ) {
+    for ( k = 0; k + 32 <= nb; k += 32 ) {
+      x	 = _mm256_loadu_si256 ( (__m256i *) & sp [ k ] );
+      y	 = _mm256_loadu_si256 ( (__m256i *) & sp [ k + 1 ] );
+      lo = _mm256_srli_epi16 ( _mm256_sll_epi16 ( _mm256_unpacklo_epi8 ( y, x ),
+						  count ), 8 );
+      hi = _mm256_srli_epi16 ( _mm256_sll_epi16 ( _mm256_unpackhi_epi8 ( y, x ),
+						  count ), 8 );
+      _mm256_storeu_si256 ( (__m256i *) & op [ k ],
+			    _mm256_packus_epi16 ( lo, hi ) );
+    }
+    for ( ; k < nb; k++ )
+      op [ k ] = ( ( sp [ k ] << 8 | sp [ k + 1 ] ) << sh ) >> 8;
+    op [ nb - 1 ] &= mask;
+  }
+}
+
+/*
+ * Digits come from a byte shuffle through the digit table, sixteen
+ * row bytes at a time.
+ */
+__attribute__ ((target ("avx2")))
+int
+  KernelAVX2HexRow ( ip, nb, op )
+register CARD8 * ip;
+int		 nb;
+register char *	 op;
+{
+  register int	j;
+  __m128i  in, hi, lo, low4, digits;
+
+  low4	 = _mm_set1_epi8 ( 0x0f );
+  digits = _mm_setr_epi8 ( '0', '1', '2', '3', '4', '5', '6', '7',
+			   '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' );
+  for ( j = 0; j < nb; j += 16 ) {
+    in = _mm_loadu_si128 ( (__m128i *) & ip [ j ] );
+    hi = _mm_shuffle_epi8 ( digits,
+			    _mm_and_si128 ( _mm_srli_epi16 ( in, 4 ), low4 ) );
+    lo = _mm_shuffle_epi8 ( digits, _mm_and_si128 ( in, low4 ) );
+    _mm256_storeu_si256 ( (__m256i *) & op [ j << 1 ],
+			  _mm256_set_m128i ( _mm_unpackhi_epi8 ( hi, lo ),
+					     _mm_unpacklo_epi8 ( hi, lo ) ) );
+  }
+  op [ nb << 1 ] = '\n';
+  return ( nb << 1 ) + 1;
+}
+
+#endif /* X86KERNELS */
+
+/*
+ * Kernel tiers, best first.  Gray unpacking of rare deep fonts has no
+ * AVX2 kernel of its own.
+ */
+KernelsRec kerneltiers [] = {
+#ifdef X86KERNELS
+  { "avx2",   KernelAVX2Supported,   KernelAVX2Extract,	  KernelSSE2Gray,
+	      KernelAVX2HexRow	 },
+  { "sse2",   KernelSSE2Supported,   KernelSSE2Extract,	  KernelSSE2Gray,
+	      KernelSSE2HexRow	 },
+#endif
+  { "scalar", KernelScalarSupported, KernelScalarExtract, KernelScalarGray,
+	      KernelScalarHexRow },
+  { (char *) NULL }
+};
+
+/*
+ * Extract all HT rows of a glyph of columns COFF0 up to COFF1, at most
+ * 8 * NB columns wide, from strike SP of RB byte rows, as packed rows of
+ * NB bytes at OP.  Each row takes one big-endian 32-bit fetch, a shift
+ * and a mask; fetched bytes past the glyph, which may lie in the next
+ * row or in the tables after the strike, are masked off.
+ */
+#define GLYPHROWS(name,nb)						\
+void									\
+  name ( sp, rb, coff0, coff1, ht, op )					\
+register CARD8 * sp;							\
+int		 rb;							\
+int		 coff0;							\
+int		 coff1;							\
+int		 ht;							\
+register CARD8 * op;							\
+{									\
+  register CARD32 v, mask;						\
+  register int	  i;							\
+									\
+  mask = (CARD32) 0xffffffff << ( 32 - ( coff1 - coff0 ) );		\
+  sp  += coff0 >> 3;							\
+  for ( i = 0; i < ht; i++, sp += rb, op += nb ) {			\
+    v = ( (CARD32) sp [ 0 ] << 24 ) | ( (CARD32) sp [ 1 ] << 16 ) |	\
+	( (CARD32) sp [ 2 ] <<	8 ) |	(CARD32) sp [ 3 ];		\
+    v = ( v << ( coff0 & 7 ) ) & mask;					\
+    op [ 0 ] = v >> 24;							\
+    if ( nb > 1 )							\
+      op [ 1 ] = v >> 16;						\
+    if ( nb > 2 )							\
+      op [ 2 ] = v >> 8;						\
+  }									\
+}
+
+GLYPHROWS ( GlyphRows8,	 1 )
+GLYPHROWS ( GlyphRows16, 2 )
+GLYPHROWS ( GlyphRows24, 3 )
+
+/*
+ * Extract all HT rows of a glyph whose columns COFF0 up to COFF1 start on
+ * a byte boundary, from strike SP of RB byte rows, as packed rows at OP.
+ * The strike bytes already are the packed row; only the columns past
+ * the glyph in its last byte need clearing.
+ */
+void
+  GlyphRowsAligned ( sp, rb, coff0, coff1, ht, op )
+register CARD8 * sp;
+int		 rb;
+int		 coff0;
+int		 coff1;
+int		 ht;
+register CARD8 * op;
+{
+  register int	i, nb;
+  CARD8	   mask;
+
+  nb   = ( ( coff1 - coff0 ) + 7 ) >> 3;
+  mask = 0xff << ( ( 8 - ( ( coff1 - coff0 ) & 7 ) ) & 7 );
+  sp  += coff0 >> 3;
+  for ( i = 0; i < ht; i++, sp += rb, op += nb ) {
+    (void) memcpy ( (char *) op, (char *) sp, nb );
+    op [ nb - 1 ] &= mask;
+  }
+}
+
+/*
+ * Width-specialized glyph extraction, by bytes per packed row.  Wider
+ * glyphs, which cannot be had with one 32-bit fetch per row, take the
+ * general path.
+ */
+void (*glyphrows [])() = {
+  NULL, GlyphRows8, GlyphRows16, GlyphRows24
+};
+
+#define NGLYPHROWS	( sizeof (glyphrows) / sizeof (glyphrows [ 0 ]) )
+
+/*
+ * Extract all HT rows of a glyph of pixels COFF0 up to COFF1 from strike
+ * SP of RB byte rows of font TP, deeper than 1 bit, as ink levels at
+ * GRAY, a byte per pixel, and thresholded at half ink as packed rows at
+ * OP.
+ */
+void
+  GlyphGray ( sp, rb, coff0, coff1, ht, tp, gray, op )
+CARD8 *		 sp;
+int		 rb;
+int		 coff0;
+int		 coff1;
+int		 ht;
+FontTables	 tp;
+register CARD8 * gray;
+register CARD8 * op;
+{
+  register int	i, j, w, nb;
+
+  w  = coff1 - coff0;
+  nb = ( w + 7 ) >> 3;
+  ( *kernels->gray ) ( sp, rb, coff0, coff1, ht, tp->depth, gray );
+  for ( i = 0; i < ht; i++, op += nb ) {
+    (void) memset ( (char *) op, 0, nb );
+    for ( j = 0; j < w; j++, gray++ ) {
+      *gray = tp->levels [ *gray ];
+      if ( *gray & 0x80 )
+	op [ j >> 3 ] |= 0x80 >> ( j & 7 );
+    }
+  }
+}
+
+/*
+ * Select glyph kernels: those of tier NAME if given, else the best the
+ * CPU supports.  Returns 1 for success, 0 if NAME is unknown or not
+ * supported.
+ */
+int
+  KernelSelect ( name )
+char *	 name;
+{
+  register Kernels kp;
+
+  for ( kp = kerneltiers; kp->name; kp++ ) {
+    if ( name && strcmp ( name, kp->name ) )
+      continue;
+    if ( ( *kp->supported ) () ) {
+      kernels = kp;
+      if ( verbose )
+	(void) printf ( "Using %s glyph kernels\n", kp->name );
+      return 1;
+    }
+    if ( name )
+      break;
+  }
+  (void) fprintf ( stderr, "%s: %s glyph kernels not available\n",
+		   progname, name ? name : "any" );
+  return 0;
+}
+
+/*
+ * Convert the N big-endian words at IP to host order at OP.  Written as
+ * a plain loop over independent words, which compilers vectorize.
+ */
+void
+  SwapWords ( ip, n, op )
+register CARD8 *  ip;
+int		  n;
+register CARD16 * op;
+{
+  register int	i;
+
+  for ( i = 0; i < n; i++ )
+    op [ i ] = (CARD16) ( ( ip [ i << 1 ] << 8 ) | ip [ ( i << 1 ) + 1 ] );
+}
+
+/*
+ * Load the glyph tables of font FP, a resource of LENGTH bytes, into TP,
+ * once for all passes over the font.  Returns 1 for success, 0 if the
+ * font's character range is bad or its tables don't fit the resource.
+ */
+int
+  FontTablesLoad ( fp, length, tp )
+register FontRsrc   fp;
+int		    length;
+register FontTables tp;
+{
+  register int i, m;
+  CARD16   fg, lg, ft;
+  INT16    ht, rw, nd;
+  CARD32   wo;
+  unsigned long locoff, owoff, owlen;
+  CARD8 *  locTable;
+  CARD8 *  owTable;
+
+  fg = toushort ( fp->ftFirstChar   );
+  lg = toushort ( fp->ftLastChar    );
+  nd = toshort  ( fp->ftNDescent    );
+  ht = toshort  ( fp->ftFRectHeight );
+  wo = toushort ( fp->ftOWTLoc      );
+  rw = toshort  ( fp->ftRowWords    );
+  ft = toushort ( fp->ftFontType    );
+
+  if ( ( lg < fg ) || ( lg - fg + 3 > MAXFONTTABLE ) ) {
+    (void) fprintf ( stderr, "%s: bad font character range %d-%d\n",
+		     progname, fg, lg );
+    return 0;
+  }
+  tp->n = lg - fg + 3;
+
+  /*
+   * Bit image and location table follow the header.
+   */
+  locoff = sizeof (FontRsrcRec) + ( (unsigned long) rw * ht << 1 );
+  if ( ( rw < 0 ) || ( ht < 0 ) ||
+       ( locoff + ( tp->n << 1 ) > (unsigned long) length ) ) {
+    (void) fprintf ( stderr, "%s: font bit image exceeds resource\n",
+		     progname );
+    return 0;
+  }
+
+  /*
+   * The offset/width table, then the optional glyph width and height
+   * tables, are at ftOWTLoc words from that field; fonts too large for
+   * 16 bits keep the high word in ftNDescent, which otherwise holds the
+   * negated descent.  Older writers let the field overflow instead, so
+   * a location out of range is taken to be right after the location
+   * table, where it always is in practice.
+   */
+  if ( nd > 0 )
+    wo |= (CARD32) nd << 16;
+  owoff = ( fp->ftOWTLoc - (CARD8 *) fp ) + ( (unsigned long) wo << 1 );
+  owlen = ( 1 + ( ( ft & 0x0002 ) != 0 ) + ( ( ft & 0x0001 ) != 0 ) ) *
+    ( tp->n << 1 );
+  if ( ( owoff < locoff + ( tp->n << 1 ) ) ||
+       ( owoff + owlen > (unsigned long) length ) )
+    owoff = locoff + ( tp->n << 1 );
+  if ( owoff + owlen > (unsigned long) length ) {
+    (void) fprintf ( stderr, "%s: font glyph tables exceed resource\n",
+		     progname );
+    return 0;
+  }
+  tp->length = owoff + owlen;
+
+  /*
+   * Pixel depth is in bits 2-3 of the font type, as a power of 2; pixel
+   * values of deep fonts are taken as even steps of ink until
+   * FontColorTable says otherwise.  Strike and locations are in pixels.
+   */
+  tp->depth = 1 << ( ( ft >> 2 ) & 3 );
+  m = ( 1 << tp->depth ) - 1;
+  for ( i = 0; i < 256; i++ )
+    tp->levels [ i ] = ( ( i & m ) * 255 ) / m;
+
+  locTable = & ( (CARD8 *) fp ) [ locoff ];
+  owTable  = & ( (CARD8 *) fp ) [ owoff	 ];
+  SwapWords ( locTable, tp->n, tp->loc );
+  SwapWords ( owTable,	tp->n, tp->ow  );
+
+  tp->maxwidth = 0;
+  for ( i = 0; i < tp->n; i++ ) {
+    if ( tp->loc [ i ] > ( rw << 4 ) / tp->depth ) {
+      (void) fprintf ( stderr, "%s: glyph location %d outside bit image\n",
+		       progname, tp->loc [ i ] );
+      return 0;
+    }
+    if ( ( i > 0 ) && ( tp->loc [ i ] - tp->loc [ i - 1 ] > tp->maxwidth ) )
+      tp->maxwidth = tp->loc [ i ] - tp->loc [ i - 1 ];
+  }
+
+  /*
+   * Glyph height table, if present, follows the offset/width table and
+   * optional glyph width table.
+   */
+  tp->hasht = ( ft & 0x0001 ) != 0;
+  if ( tp->hasht )
+    SwapWords ( & owTable [ ( tp->n << 1 ) * ( ( ft & 0x0002 ) ? 2 : 1 ) ],
+		tp->n, tp->ht );
+  return 1;
+}
+
+/*
+ * Take the ink levels of the pixel values of deep font TP from the
+ * CTABLEN bytes of its color table CTAB: full ink for black, none for
+ * white, between by luminance.  Returns 1 for success, 0 if the table is
+ * malformed, leaving TP's levels as they were.
+ */
+int
+  FontColorTable ( tp, ctab, ctablen )
+FontTables tp;
+CARD8 *	   ctab;
+int	   ctablen;
+{
+  register int	i, n;
+  register ColorSpec cs;
+  CARD8	   levels [ 256 ];
+  long	   lum;
+
+  if ( ctablen < (int) sizeof (ColorTableRec) )
+    return 0;
+  n = toushort ( ( (ColorTable) ctab )->ctSize ) + 1;
+  if ( ( n > 256 ) ||
+       ( sizeof (ColorTableRec) + n * sizeof (ColorSpecRec) >
+	 (unsigned long) ctablen ) )
+    return 0;
+
+  (void) memcpy ( (char *) levels, (char *) tp->levels, sizeof (levels) );
+  cs = (ColorSpec) & ctab [ sizeof (ColorTableRec) ];
+  for ( i = 0; i < n; i++, cs++ ) {
+    lum = ( (long) toushort ( cs->csRed	  ) * 299 +
+	    (long) toushort ( cs->csGreen ) * 587 +
+	    (long) toushort ( cs->csBlue  ) * 114 ) / 1000;
+    levels [ toushort ( cs->csValue ) & ( ( 1 << tp->depth ) - 1 ) ] =
+      255 - ( lum >> 8 );
+  }
+  (void) memcpy ( (char *) tp->levels, (char *) levels, sizeof (levels) );
+  return 1;
+}
+
+/*
+ * Time glyph extraction and hex encoding of every glyph of font FP, a
+ * resource of LENGTH bytes, over PASSES passes with each kernel tier the
+ * CPU supports, and report the cost per glyph of each to FOUT.  Every
+ * glyph takes the tier's general path, not the width-specialized ones,
+ * so the tiers are compared on the same work.  Returns 1 for success, 0
+ * if the font is bad or memory is short.
+ */
+int
+  KernelBench ( fp, length, passes, fout )
+FontRsrc fp;
+int	 length;
+int	 passes;
+FILE *	 fout;
+{
+  register Kernels kp;
+  register int i, p;
+  CARD16   coff0, coff1;
+  INT16    ht, rw;
+  CARD8 *  bitImage;
+  CARD8 *  rowbuf;
+  CARD8 *  graybuf;
+  char *   hexbuf;
+  int	   nb, nbmax, nr, ng;
+  clock_t  t0;
+  FontTablesRec tables;
+
+  if ( ! FontTablesLoad ( fp, length, & tables ) )
+    return 0;
+  ht	   = toshort ( fp->ftFRectHeight );
+  rw	   = toshort ( fp->ftRowWords	 );
+  bitImage = (CARD8 *) & fp [ 1 ];
+
+  nbmax	  = ( tables.maxwidth + 7 ) >> 3;
+  rowbuf  = (CARD8 *) calloc ( nbmax * ht + 16, 1 );
+  hexbuf  = (char *) malloc ( ( nbmax << 1 ) + 32 );
+  graybuf = (CARD8 *) malloc ( tables.maxwidth * ht + 16 );
+  if ( ! rowbuf || ! hexbuf || ! graybuf ) {
+    (void) fprintf ( stderr, "%s: out of memory: kernel benchmark\n",
+		     progname );
+    if ( rowbuf )
+      free ( (char *) rowbuf );
+    if ( hexbuf )
+      free ( hexbuf );
+    if ( graybuf )
+      free ( (char *) graybuf );
+    return 0;
+  }
+
+  for ( kp = kerneltiers; kp->name; kp++ ) {
+    if ( ! ( *kp->supported ) () )
+      continue;
+    t0 = clock ();
+    for ( p = 0, ng = 0; p < passes; p++ ) {
+      for ( i = 0; i < tables.n - 2; i++ ) {
+	coff0 = tables.loc [ i + 0 ];
+	coff1 = tables.loc [ i + 1 ];
+	if ( coff0 >= coff1 )
+	  continue;
+	nb = ( ( coff1 - coff0 ) + 7 ) >> 3;
+	if ( tables.depth > 1 )
+	  ( *kp->gray ) ( bitImage, rw << 1, coff0, coff1, ht, tables.depth,
+			  graybuf );
+	else
+	  ( *kp->extract ) ( bitImage, rw << 1, coff0, coff1, ht, rowbuf );
+	for ( nr = 0; nr < ht; nr++ )
+	  ( *kp->hexrow ) ( & rowbuf [ nr * nb ], nb, hexbuf );
+	ng++;
+      }
+    }
+    (void) fprintf ( fout, "Kernels: %-6s %8.1f ns per glyph\n", kp->name,
+		     ng ? 1e9 * ( clock () - t0 ) / CLOCKS_PER_SEC / ng : 0.0 );
+  }
+
+  free ( (char *) rowbuf );
+  free ( hexbuf );
+  free ( (char *) graybuf );
+  return 1;
+}
+
+/*
+ * Find font bounding box and total number of glyphs.  The box is that of
+ * the union of all glyphs, so it spans every row and every column that
+ * is set in any glyph; these are accumulated as a row flag per strike
+ * row and a packed column mask, 16 columns per word, never building the
+ * union image itself.
+ */
+void
+  FontInfo ( fp, tp, ret_top, ret_left, ret_bottom, ret_right, ret_ng )
+register FontRsrc fp;
+FontTables tp;
+INT16	*ret_top;
+INT16	*ret_left;
+INT16	*ret_bottom;
+INT16	*ret_right;
+INT16	*ret_ng;
+{
+  register int i, j, d, s;
+  register CARD8  *rp;
+  register CARD32 v;
+  CARD16   g, fg, lg, coff0, coff1, ow;
+  INT16    mk, wd, ht, rw, xoff, top, bot, left, right, ng;
+  int	   nw, cw, rb, c0, c1;
+  CARD8 *  bitImage;
+  CARD8 *  sp;
+  CARD8 *  rows;
+  CARD16 * cols;
+  CARD8 *  gray   = (CARD8 *) NULL;
+  CARD8 *  packed = (CARD8 *) NULL;
+
+  top = bot = left = right = 0;
+
+  fg = toushort ( fp->ftFirstChar   );
+  lg = toushort ( fp->ftLastChar    );
+  mk = toshort  ( fp->ftKernMax     );
+  wd = toshort  ( fp->ftFRectWidth  );
+  ht = toshort  ( fp->ftFRectHeight );
+  rw = toshort  ( fp->ftRowWords    );
+
+  bitImage = (CARD8 * ) & fp [ 1 ];
+
+  if ( lg == fg )
+    return;
+
+  /*
+   * Size column mask for the widest placed glyph, which is at most the
+   * font rectangle width in a well formed font.
+   */
+  cw = wd;
+  for ( g = fg; g <= lg; g++ ) {
+    coff0 = tp->loc [ ( g - fg ) + 0 ];
+    coff1 = tp->loc [ ( g - fg ) + 1 ];
+    ow	  = tp->ow  [ g - fg ];
+    xoff  = ( ( ow >> 8 ) & 0xff ) + mk;
+    if ( ( coff1 > coff0 ) && ( xoff + ( coff1 - coff0 ) > cw ) )
+      cw = xoff + ( coff1 - coff0 );
+  }
+  nw   = ( cw + 15 ) >> 4;
+  rows = (CARD8 *) alloca ( ht );
+  cols = (CARD16 *) alloca ( ( nw + 1 ) * sizeof (CARD16) );
+  (void) memset ( (char *) rows, 0, ht );
+  (void) memset ( (char *) cols, 0, ( nw + 1 ) * sizeof (CARD16) );
+
+  /*
+   * Glyphs of deep fonts are thresholded one at a time to packed rows,
+   * which are then read as a strike of their own.
+   */
+  if ( tp->depth > 1 ) {
+    gray   = (CARD8 *) alloca ( tp->maxwidth * ht + 1 );
+    packed = (CARD8 *) alloca ( ( ( tp->maxwidth + 7 ) >> 3 ) * ht + 1 );
+  }
+
+  for ( g = fg, ng = 0; g <= lg; g++ ) {
+
+    /*
+     * Get starting and ending offset columns in bit image.
+     */
+    coff0 = tp->loc [ ( g - fg ) + 0 ];
+    coff1 = tp->loc [ ( g - fg ) + 1 ];
+    if ( coff0 >= coff1 )
+      continue;
+
+    /*
+     * Get basepoint offset and escapement.
+     */
+    ow    = tp->ow  [ g - fg ];
+    xoff  = ( ( ow >> 8 ) & 0xff ) + mk;
+
+    if ( tp->depth > 1 ) {
+      GlyphGray ( bitImage, rw << 1, coff0, coff1, ht, tp, gray, packed );
+      sp = packed;
+      rb = ( ( coff1 - coff0 ) + 7 ) >> 3;
+      c0 = 0;
+      c1 = coff1 - coff0;
+    } else {
+      sp = bitImage;
+      rb = rw << 1;
+      c0 = coff0;
+      c1 = coff1;
+    }
+
+    /*
+     * Merge glyph into row flags and column mask, 16 columns at a time:
+     * fetch the three strike bytes covering the columns, left justify
+     * them, mask off columns past the glyph, and skip those left of the
+     * font origin.
+     */
+    for ( i = 0; i < ht; i++ ) {
+      rp = & sp [ i * rb ];
+      for ( j = c0; j < c1; j += 16 ) {
+	v = (CARD32) rp [ j >> 3 ] << 16;
+	if ( ( j >> 3 ) + 1 < rb )
+	  v |= (CARD32) rp [ ( j >> 3 ) + 1 ] << 8;
+	if ( ( j >> 3 ) + 2 < rb )
+	  v |= (CARD32) rp [ ( j >> 3 ) + 2 ];
+	v = ( v >> ( 8 - ( j & 7 ) ) ) & 0xffff;
+	if ( c1 - j < 16 )
+	  v &= 0xffff0000 >> ( c1 - j );
+	d = ( j - c0 ) + xoff;
+	if ( d < 0 ) {
+	  v = ( d > -16 ) ? ( v << -d ) & 0xffff : 0;
+	  d = 0;
+	}
+	if ( ! v )
+	  continue;
+	rows [ i ] = 1;
+	s = d & 15;
+	cols [ ( d >> 4 ) + 0 ] |= v >> s;
+	cols [ ( d >> 4 ) + 1 ] |= ( v << ( 16 - s ) ) & 0xffff;
+      }
+    }
+
+    ng++;
+  }
+
+  /*
+   * Find top and bottom of bounding box.
+   */
+  top = ht;
+  bot = 0;
+  for ( i = 0; i < ht; i++ ) {
+    if ( rows [ i ] && ( i < top ) )
+      top = i;
+    if ( rows [ i ] && ( i > bot ) )
+      bot = i;
+  }
+
+  /*
+   * Find left and right of bounding box from the first and last set
+   * bits of the column mask.
+   */
+  left  = wd;
+  right = 0;
+  for ( i = 0; ( i < nw ) && ! cols [ i ]; i++ )
+    ;
+  if ( i < nw ) {
+    for ( v = cols [ i ], j = 0; ! ( v & 0x8000 ); v <<= 1, j++ )
+      ;
+    left = ( i << 4 ) + j;
+    for ( i = nw - 1; ! cols [ i ]; i-- )
+      ;
+    for ( v = cols [ i ], j = 15; ! ( v & 1 ); v >>= 1, j-- )
+      ;
+    right = ( i << 4 ) + j;
+  }
+
+#ifdef notdef
+  if ( ( ( right - left ) + 1 ) != wd )
+    (void) fprintf ( stderr,
+		    "%s: warning: bbox width mismatch, got %d, expected %d\n",
+		    progname, ( right - left ) + 1, wd );
+  if ( ( ( bot - top ) + 1 ) != ht )
+    (void) fprintf ( stderr,
+		    "%s: warning: bbox height mismatch, got %d, expected %d\n",
+		    progname, ( bot - top ) + 1, ht );
+#endif
+
+  *ret_top    = top;
+  *ret_left   = left + mk;
+  *ret_bottom = bot;
+  *ret_right  = right + mk;
+  *ret_ng     = ng;
+}
+
+/*
+ * Classify font spacing as XLFD proportional ('P'), monospaced ('M'),
+ * where all glyphs share one escapement, or character cell ('C'), where
+ * in addition every glyph's ink lies within its cell.  Also find the
+ * average escapement in tenths of pixels, and, if the location table
+ * advances uniformly, its stride, with the shared offset/width entry if
+ * all glyphs have the same one, else -1; the stride is 0 otherwise.
+ */
+int
+  FontSpacing ( fp, tp, ret_avgwidth, ret_stride, ret_ow )
+register FontRsrc fp;
+FontTables tp;
+int *	 ret_avgwidth;
+int *	 ret_stride;
+int *	 ret_ow;
+{
+  register int	g;
+  CARD16   fg, lg, coff0, coff1, ow;
+  INT16    mk, xoff;
+  int	   ng, esc, owall, stride, mono, cell;
+  long	   total;
+
+  fg = toushort ( fp->ftFirstChar   );
+  lg = toushort ( fp->ftLastChar    );
+  mk = toshort  ( fp->ftKernMax     );
+
+  ng	 = 0;
+  esc	 = -1;
+  owall	 = -1;
+  total	 = 0;
+  mono	 = 1;
+  cell	 = 1;
+  stride = tp->loc [ 1 ] - tp->loc [ 0 ];
+  for ( g = fg; g <= lg; g++ ) {
+    coff0 = tp->loc [ ( g - fg ) + 0 ];
+    coff1 = tp->loc [ ( g - fg ) + 1 ];
+    if ( coff1 - coff0 != stride )
+      stride = 0;
+    if ( coff0 >= coff1 )
+      continue;
+    ow	 = tp->ow [ g - fg ];
+    xoff = ( ( ow >> 8 ) & 0xff ) + mk;
+    if ( ! ng )
+      owall = ow;
+    else if ( ow != owall )
+      owall = -1;
+    if ( ! ng )
+      esc = ow & 0xff;
+    else if ( ( ow & 0xff ) != esc )
+      mono = 0;
+    if ( ( xoff < 0 ) || ( xoff + ( coff1 - coff0 ) > ( ow & 0xff ) ) )
+      cell = 0;
+    total += ow & 0xff;
+    ng++;
+  }
+
+  *ret_avgwidth = ng ? (int) ( ( total * 10 + ng / 2 ) / ng ) : 0;
+  *ret_stride	= ( stride > 0 ) ? stride : 0;
+  *ret_ow	= owall;
+  if ( ! ng || ! mono )
+    return 'P';
+  return cell ? 'C' : 'M';
+}
+
+char *
+  FontStyleName ( style )
+int style;
+{
+  static char sname [ 128 ];
+  char *retsname;
+
+  sname [ 0 ] = '\0';
+  if ( style & 0001 )
+    (void) strcat ( sname, "Bold" );
+  if ( style & 0002 )
+    (void) strcat ( sname, "Italic" );
+  if ( style & 0004 )
+    (void) strcat ( sname, "Underlined" );
+  if ( style & 0010 )
+    (void) strcat ( sname, "Outlined" );
+  if ( style & 0020 )
+    (void) strcat ( sname, "Shadowed" );
+  if ( style & 0040 )
+    (void) strcat ( sname, "Condensed" );
+  if ( style & 0100 )
+    (void) strcat ( sname, "Extended" );
+
+  retsname = (char *) malloc (strlen(sname) + 1);
+  strcpy(retsname, sname);
+  return retsname;
+}
+
+/*
+ * 32-bit FNV-1a hash of N bytes at P, continuing from H.
+ */
+CARD32
+  HashBytes ( p, n, h )
+register CARD8 *p;
+register CARD32 n;
+register CARD32 h;
+{
+  while ( n-- ) {
+    h ^= *p++;
+    h *= 16777619;
+  }
+  return h;
+}
+
+/*
+ * Generate cache file name for font from a hash of the font resource
+ * and the canonical font name, style, and size, and of any option that
+ * changes the BDF written for it.  Two independently seeded hash lanes
+ * are used to form a 64-bit key.
+ */
+void
+  FontCacheName ( fp, tp, name, style, size, cname )
+FontRsrc fp;
+FontTables tp;
+char *	 name;
+int	 style;
+int	 size;
+char *	 cname;
+{
+  CARD32   h [ 2 ];
+  char     key [ 64 ];
+  int	   n;
+
+  (void) sprintf ( key, "%d.%d.%d.%d", style, size, verifyheights != 0,
+		   CACHEVERSION );
+  for ( n = 0; n < 2; n++ ) {
+    h [ n ] = n ? 0x050c5d1f : 0x811c9dc5;
+    h [ n ] = HashBytes ( (CARD8 *) fp, tp->length, h [ n ] );
+    if ( tp->depth > 1 )
+      h [ n ] = HashBytes ( tp->levels, (CARD32) sizeof (tp->levels), h [ n ] );
+    h [ n ] = HashBytes ( (CARD8 *) name, (CARD32) strlen ( name ), h [ n ] );
+    h [ n ] = HashBytes ( (CARD8 *) key, (CARD32) strlen ( key ), h [ n ] );
+  }
+  (void) sprintf ( cname, "%.1000s/%08lx%08lx.bdf", cachedir,
+		   (unsigned long) h [ 0 ], (unsigned long) h [ 1 ] );
+}
+
+/*
+ * Copy file FROM to TO, returning non-zero on success.
+ */
+int
+  CopyFile ( from, to )
+char *	 from;
+char *	 to;
+{
+  FILE *   fin;
+  FILE *   fout;
+  char	   buf [ 8192 ];
+  size_t   n;
+  int	   ok = 1;
+
+  if ( ! ( fin = fopen ( from, "r" ) ) )
+    return 0;
+  if ( ! ( fout = fopen ( to, "w" ) ) ) {
+    (void) fclose ( fin );
+    return 0;
+  }
+  while ( ( n = fread ( buf, 1, sizeof (buf), fin ) ) > 0 ) {
+    if ( fwrite ( buf, 1, n, fout ) != n ) {
+      ok = 0;
+      break;
+    }
+  }
+  if ( ferror ( fin ) )
+    ok = 0;
+  (void) fclose ( fin );
+  if ( fclose ( fout ) != 0 )
+    ok = 0;
+  return ok;
+}
+
+/*
+ * Reuse cached output CNAME as FNAME, preferring a hard link over a
+ * copy.  Returns non-zero on a cache hit.
+ */
+int
+  FontCacheFetch ( cname, fname )
+char *	 cname;
+char *	 fname;
+{
+  if ( access ( cname, R_OK ) != 0 )
+    return 0;
+  (void) unlink ( fname );
+  if ( link ( cname, fname ) == 0 )
+    return 1;
+  return CopyFile ( cname, fname );
+}
+
+/*
+ * Record output FNAME in cache as CNAME.
+ */
+int
+  FontCacheStore ( fname, cname )
+char *	 fname;
+char *	 cname;
+{
+  (void) unlink ( cname );
+  if ( link ( fname, cname ) == 0 )
+    return 1;
+  return CopyFile ( fname, cname );
+}
+
+/*
+ * Report cache statistics.
+ */
+void
+  FontCacheStats ( fout )
+FILE *	 fout;
+{
+  if ( ! cachedir )
+    return;
+  (void) fprintf ( fout, "Cache: %d hits, %d misses\n",
+		   cachehits, cachemisses );
+}
+
+/*
+ * Find manifest entry for input PATH, optionally creating it.
+ */
+Manifest
+  ManifestFind ( path, create )
+char *	 path;
+int	 create;
+{
+  register Manifest mp, *mpp;
+
+  mpp = & manifest [ HashBytes ( (CARD8 *) path, (CARD32) strlen ( path ),
+				 0x811c9dc5 ) % MANIFESTHASH ];
+  for ( mp = *mpp; mp; mp = mp->next )
+    if ( strcmp ( mp->path, path ) == 0 )
+      return mp;
+  if ( ! create )
+    return (Manifest) NULL;
+  if ( ! ( mp = (Manifest) malloc ( sizeof (*mp) ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: manifest\n", progname );
+    return (Manifest) NULL;
+  }
+  mp->path    = strdup ( path );
+  mp->size    = -1;
+  mp->mtime   = -1;
+  mp->outputs = (OutputName) NULL;
+  mp->next    = *mpp;
+  *mpp        = mp;
+  return mp;
+}
+
+/*
+ * Add output NAME to manifest entry MP.
+ */
+void
+  ManifestAddOutput ( mp, name )
+Manifest mp;
+char *	 name;
+{
+  register OutputName on, *onp;
+
+  if ( ! mp )
+    return;
+  for ( onp = & mp->outputs; *onp; onp = & (*onp)->next )
+    if ( strcmp ( (*onp)->name, name ) == 0 )
+      return;
+  if ( ! ( on = (OutputName) malloc ( sizeof (*on) ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: manifest\n", progname );
+    return;
+  }
+  on->name = strdup ( name );
+  on->next = (OutputName) NULL;
+  *onp     = on;
+}
+
+/*
+ * Load manifest from file PATH, which consists of lines of the form
+ * "I size mtime input" each followed by zero or more "O output" lines.
+ * A missing manifest is not an error.
+ */
+int
+  ManifestLoad ( path )
+char *	 path;
+{
+  FILE *   fin;
+  Manifest mp = (Manifest) NULL;
+  char	   buf [ 2048 ];
+  char *   cp;
+  long	   size, mtime;
+  int	   off;
+
+  if ( ! ( fin = fopen ( path, "r" ) ) )
+    return 1;
+  while ( fgets ( buf, sizeof (buf), fin ) ) {
+    if ( ( cp = strchr ( buf, '\n' ) ) )
+      *cp = '\0';
+    if ( ( buf [ 0 ] == 'I' ) &&
+	 ( sscanf ( buf, "I %ld %ld %n", & size, & mtime, & off ) == 2 ) ) {
+      if ( ( mp = ManifestFind ( & buf [ off ], 1 ) ) ) {
+	mp->size  = size;
+	mp->mtime = mtime;
+      }
+    } else if ( ( buf [ 0 ] == 'O' ) && ( buf [ 1 ] == ' ' ) && mp )
+      ManifestAddOutput ( mp, & buf [ 2 ] );
+  }
+  (void) fclose ( fin );
+  return 1;
+}
+
+/*
+ * Save manifest to file PATH, replacing it atomically.
+ */
+int
+  ManifestSave ( path )
+char *	 path;
+{
+  FILE *   fout;
+  register Manifest mp;
+  register OutputName on;
+  char	   tname [ 1024 ];
+  int	   n;
+
+  (void) sprintf ( tname, "%.1000s.tmp", path );
+  if ( ! ( fout = fopen ( tname, "w" ) ) ) {
+    (void) fprintf ( stderr, "%s: can't create manifest \"%s\"\n",
+		     progname, tname );
+    return 0;
+  }
+  for ( n = 0; n < MANIFESTHASH; n++ ) {
+    for ( mp = manifest [ n ]; mp; mp = mp->next ) {
+      if ( mp->size < 0 )
+	continue;
+      (void) fprintf ( fout, "I %ld %ld %s\n", mp->size, mp->mtime, mp->path );
+      for ( on = mp->outputs; on; on = on->next )
+	(void) fprintf ( fout, "O %s\n", on->name );
+    }
+  }
+  if ( ( fclose ( fout ) != 0 ) || ( rename ( tname, path ) != 0 ) ) {
+    (void) fprintf ( stderr, "%s: can't write manifest \"%s\"\n",
+		     progname, path );
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * Determine if input PATH is unchanged since the manifest was written,
+ * i.e., its size and modification time match and all of its outputs
+ * still exist.  Only the input's inode is examined; it is not opened.
+ */
+int
+  ManifestFresh ( path )
+char *	 path;
+{
+  register Manifest mp;
+  register OutputName on;
+  struct stat st;
+
+  if ( ! ( mp = ManifestFind ( path, 0 ) ) )
+    return 0;
+  if ( stat ( path, & st ) != 0 )
+    return 0;
+  if ( ( (long) st.st_size != mp->size ) || ( (long) st.st_mtime != mp->mtime ) )
+    return 0;
+  for ( on = mp->outputs; on; on = on->next )
+    if ( access ( on->name, F_OK ) != 0 )
+      return 0;
+  return 1;
+}
+
+/*
+ * Begin (re)building input PATH; outputs produced by FontDump are
+ * recorded against it until the next call.
+ */
+void
+  ManifestBegin ( path )
+char *	 path;
+{
+  register OutputName on, next;
+  struct stat st;
+
+  if ( ! ( manifestcur = ManifestFind ( path, 1 ) ) )
+    return;
+  for ( on = manifestcur->outputs; on; on = next ) {
+    next = on->next;
+    free ( on->name );
+    free ( (char *) on );
+  }
+  manifestcur->outputs = (OutputName) NULL;
+  if ( stat ( path, & st ) == 0 ) {
+    manifestcur->size  = (long) st.st_size;
+    manifestcur->mtime = (long) st.st_mtime;
+  } else
+    manifestcur->size  = manifestcur->mtime = -1;
+}
+
+/*
+ * Intern glyph with NBYTES of packed bitmap BITS, ink levels GRAY if not
+ * NULL, and the given metrics, returning the shared glyph record.
+ */
+Glyph
+  GlyphIntern ( bits, nbytes, gray, width, height, xoff, yoff, advance )
+CARD8 *	 bits;
+int	 nbytes;
+CARD8 *	 gray;
+int	 width;
+int	 height;
+int	 xoff;
+int	 yoff;
+int	 advance;
+{
+  register Glyph gp, *gpp;
+  CARD32   h;
+  INT16	   metrics [ 5 ];
+  int	   ngray;
+
+  metrics [ 0 ] = width;
+  metrics [ 1 ] = height;
+  metrics [ 2 ] = xoff;
+  metrics [ 3 ] = yoff;
+  metrics [ 4 ] = advance;
+  h = HashBytes ( (CARD8 *) metrics, (CARD32) sizeof (metrics), 0x811c9dc5 );
+  h = HashBytes ( bits, (CARD32) nbytes, h );
+  ngray = gray ? width * height : 0;
+  if ( gray )
+    h = HashBytes ( gray, (CARD32) ngray, h );
+
+  nglyphs++;
+  glyphbytes += nbytes + ngray;
+  gpp = & glyphhash [ h % GLYPHHASH ];
+  for ( gp = *gpp; gp; gp = gp->next ) {
+    if ( ( gp->hash == h ) && ( gp->nbytes == nbytes ) &&
+	 ( gp->width == width ) && ( gp->height == height ) &&
+	 ( gp->xoff == xoff ) && ( gp->yoff == yoff ) &&
+	 ( gp->advance == advance ) && ( ! gp->gray == ! gray ) &&
+	 ( memcmp ( (char *) gp->bits, (char *) bits, nbytes ) == 0 ) &&
+	 ( ! gray ||
+	   ( memcmp ( (char *) gp->gray, (char *) gray, ngray ) == 0 ) ) ) {
+      gp->refs++;
+      return gp;
+    }
+  }
+
+  if ( ! ( gp = (Glyph) malloc ( sizeof (*gp) + nbytes + ngray ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: glyph intern\n", progname );
+    return (Glyph) NULL;
+  }
+  gp->hash    = h;
+  gp->width   = width;
+  gp->height  = height;
+  gp->xoff    = xoff;
+  gp->yoff    = yoff;
+  gp->advance = advance;
+  gp->nbytes  = nbytes;
+  gp->refs    = 1;
+  gp->index   = nuniqueglyphs++;
+  gp->bits    = (CARD8 *) & gp [ 1 ];
+  (void) memcpy ( (char *) gp->bits, (char *) bits, nbytes );
+  gp->gray    = gray ? & gp->bits [ nbytes ] : (CARD8 *) NULL;
+  if ( gray )
+    (void) memcpy ( (char *) gp->gray, (char *) gray, ngray );
+  gp->next    = *gpp;
+  *gpp	      = gp;
+  uniqueglyphbytes += nbytes + ngray;
+  return gp;
+}
+
+/*
+ * Report glyph deduplication statistics.
+ */
+void
+  GlyphStats ( fout )
+FILE *	 fout;
+{
+  if ( ! nglyphs )
+    return;
+  (void) fprintf ( fout,
+		   "Glyphs: %d total, %d unique (%.1f%%), %ld of %ld bitmap bytes\n",
+		   nglyphs, nuniqueglyphs,
+		   100.0 * nuniqueglyphs / nglyphs,
+		   uniqueglyphbytes, glyphbytes );
+}
+
+/*
+ * Order glyphs for shelf packing: tallest first, then widest.
+ */
+int
+  AtlasGlyphCompare ( a, b )
+const void * a;
+const void * b;
+{
+  register Glyph ga = * (Glyph *) a;
+  register Glyph gb = * (Glyph *) b;
+
+  if ( ga->height != gb->height )
+    return (int) gb->height - (int) ga->height;
+  return (int) gb->width - (int) ga->width;
+}
+
+/*
+ * Write the N glyphs of FGLYPHS as atlas image NAME.pgm, shelf packed
+ * with a pixel of padding, and atlas metrics NAME.atl.  Glyphs with
+ * identical bitmaps and metrics share one atlas rectangle.  Pixels are
+ * full ink, or for deep fonts the glyph's ink levels.  Returns 1 for
+ * success, 0 for failure.
+ */
+int
+  AtlasDump ( name, fglyphs, n, ascent, descent )
+char *	  name;
+FontGlyph fglyphs;
+int	  n;
+int	  ascent;
+int	  descent;
+{
+  register int	i, j, k, r, c;
+  register Glyph gp;
+  Glyph *  ug;
+  CARD16 * ux;
+  CARD16 * uy;
+  int	   nu, nb, wd, ht, x, y, sh;
+  long	   area;
+  CARD8 *  image;
+  CARD8 *  bits;
+  AtlasHdrRec ah;
+  AtlasGlyphRec ag;
+  FILE *   fout;
+  char	   fname [ 1024 ];
+
+  if ( ! ( ug = (Glyph *) malloc ( ( n + 1 ) * ( sizeof (Glyph) +
+						 2 * sizeof (CARD16) ) ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: atlas\n", progname );
+    return 0;
+  }
+  ux = (CARD16 *) & ug [ n + 1 ];
+  uy = & ux [ n + 1 ];
+
+  /*
+   * Collect distinct non-blank glyphs and size the atlas: a power of two
+   * wide, enough for a square of their padded area.
+   */
+  nu   = 0;
+  wd   = 16;
+  area = 0;
+  for ( i = 0; i < n; i++ ) {
+    gp = fglyphs [ i ].glyph;
+    if ( ! gp->height )
+      continue;
+    for ( j = 0; ( j < nu ) && ( ug [ j ] != gp ); j++ )
+      ;
+    if ( j < nu )
+      continue;
+    ug [ nu++ ] = gp;
+    area += (long) ( gp->width + 1 ) * ( gp->height + 1 );
+    while ( wd < gp->width + 1 )
+      wd <<= 1;
+  }
+  while ( (long) wd * wd < area )
+    wd <<= 1;
+  qsort ( (char *) ug, nu, sizeof (Glyph), AtlasGlyphCompare );
+
+  /*
+   * Place glyphs left to right on shelves as tall as their first glyph.
+   */
+  x  = 0;
+  y  = 0;
+  sh = 0;
+  for ( j = 0; j < nu; j++ ) {
+    if ( x + ug [ j ]->width + 1 > wd ) {
+      x  = 0;
+      y += sh;
+      sh = 0;
+    }
+    if ( ! sh )
+      sh = ug [ j ]->height + 1;
+    ux [ j ] = x;
+    uy [ j ] = y;
+    x += ug [ j ]->width + 1;
+  }
+  ht = y + sh;
+  if ( ! ht )
+    ht = 1;
+
+  if ( ! ( image = (CARD8 *) calloc ( wd * ht, 1 ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: atlas\n", progname );
+    free ( (char *) ug );
+    return 0;
+  }
+  for ( j = 0; j < nu; j++ ) {
+    gp	 = ug [ j ];
+    nb	 = ( gp->width + 7 ) >> 3;
+    for ( r = 0, bits = gp->bits; r < gp->height; r++, bits += nb ) {
+      if ( gp->gray ) {
+	(void) memcpy ( (char *) & image [ ( uy [ j ] + r ) * wd + ux [ j ] ],
+			(char *) & gp->gray [ r * gp->width ], gp->width );
+	continue;
+      }
+      for ( c = 0; c < gp->width; c++ ) {
+	if ( ( bits [ c >> 3 ] >> ( 7 - ( c & 7 ) ) ) & 1 )
+	  image [ ( uy [ j ] + r ) * wd + ux [ j ] + c ] = 0xff;
+      }
+    }
+  }
+
+  /*
+   * Write atlas image.
+   */
+  (void) sprintf ( fname, "%s.pgm", name );
+  if ( ! ( fout = fopen ( fname, "wb" ) ) ) {
+    (void) fprintf ( stderr, "%s: can't create output file \"%s\"\n",
+		     progname, fname );
+    free ( (char *) image );
+    free ( (char *) ug );
+    return 0;
+  }
+  if ( ! quiet )
+    (void) printf  ( "Dumping %d glyph atlas %dx%d to \"%s\"\n",
+		     nu, wd, ht, fname );
+  (void) fprintf ( fout, "P5\n%d %d\n255\n", wd, ht );
+  (void) fwrite ( (char *) image, 1, wd * ht, fout );
+  (void) fclose ( fout );
+  free ( (char *) image );
+  ManifestAddOutput ( manifestcur, fname );
+
+  /*
+   * Write atlas metrics.
+   */
+  (void) sprintf ( fname, "%s.atl", name );
+  if ( ! ( fout = fopen ( fname, "wb" ) ) ) {
+    (void) fprintf ( stderr, "%s: can't create output file \"%s\"\n",
+		     progname, fname );
+    free ( (char *) ug );
+    return 0;
+  }
+  (void) memset ( (char *) & ah, 0, sizeof (ah) );
+  (void) memcpy ( ah.ahMagic, ATLASMAGIC, 4 );
+  ah.ahByteOrder = 0x0102;
+  ah.ahVersion	 = ATLASVERSION;
+  ah.ahNGlyphs	 = n;
+  ah.ahWidth	 = wd;
+  ah.ahHeight	 = ht;
+  ah.ahAscent	 = ascent;
+  ah.ahDescent	 = descent;
+  (void) fwrite ( (char *) & ah, sizeof (ah), 1, fout );
+  for ( i = 0; i < n; i++ ) {
+    gp = fglyphs [ i ].glyph;
+    for ( k = 0; ( k < nu ) && ( ug [ k ] != gp ); k++ )
+      ;
+    ag.agCode	  = fglyphs [ i ].code;
+    ag.agAdvance  = gp->advance;
+    ag.agXOff	  = gp->xoff;
+    ag.agYOff	  = gp->yoff;
+    ag.agX	  = ( k < nu ) ? ux [ k ] : 0;
+    ag.agY	  = ( k < nu ) ? uy [ k ] : 0;
+    ag.agWidth	  = ( k < nu ) ? gp->width  : 0;
+    ag.agHeight	  = ( k < nu ) ? gp->height : 0;
+    (void) fwrite ( (char *) & ag, sizeof (ag), 1, fout );
+  }
+  (void) fclose ( fout );
+  free ( (char *) ug );
+  ManifestAddOutput ( manifestcur, fname );
+  return 1;
+}
+
+/*
+ * Write the N glyphs of FGLYPHS as C header NAME.h of static constant
+ * tables: packed bitmaps in character code order, and per-glyph metrics
+ * with bitmap offsets indexed directly by character code.  Glyphs with
+ * identical bitmaps and metrics share one bitmap.  Returns 1 for
+ * success, 0 for failure.
+ */
+int
+  CTableDump ( name, fglyphs, n, ascent, descent )
+char *	  name;
+FontGlyph fglyphs;
+int	  n;
+int	  ascent;
+int	  descent;
+{
+  register int	i, j, k;
+  register Glyph gp;
+  register char *cp;
+  long *   offsets;
+  long	   off;
+  int	   first, last;
+  FILE *   fout;
+  char	   fname [ 1024 ];
+  char	   id	 [ 1024 ];
+
+  if ( ! n )
+    return 1;
+
+  /*
+   * Derive C identifier from the output file's base name.
+   */
+  if ( ( cp = strrchr ( name, '/' ) ) )
+    cp++;
+  else
+    cp = name;
+  if ( isdigit ( (unsigned char) *cp ) )
+    (void) sprintf ( id, "_%.1000s", cp );
+  else
+    (void) sprintf ( id, "%.1000s", cp );
+  for ( cp = id; *cp; cp++ )
+    if ( ! isalnum ( (unsigned char) *cp ) )
+      *cp = '_';
+
+  if ( ! ( offsets = (long *) malloc ( n * sizeof (long) ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: C tables\n", progname );
+    return 0;
+  }
+
+  (void) sprintf ( fname, "%s.h", name );
+  if ( ! ( fout = fopen ( fname, "w" ) ) ) {
+    (void) fprintf ( stderr, "%s: can't create output file \"%s\"\n",
+		     progname, fname );
+    free ( (char *) offsets );
+    return 0;
+  }
+  if ( ! quiet )
+    (void) printf  ( "Dumping %d glyphs to \"%s\"\n", n, fname );
+
+  first = fglyphs [ 0     ].code;
+  last	= fglyphs [ n - 1 ].code;
+  (void) fprintf ( fout, "/* %s: generated by %s; do not edit. */\n\n",
+		   fname, progname );
+  (void) fprintf ( fout, "#ifndef MAC2BDF_GLYPH\n" );
+  (void) fprintf ( fout, "#define MAC2BDF_GLYPH\n" );
+  (void) fprintf ( fout, "typedef struct {\n" );
+  (void) fprintf ( fout, "  unsigned long  offset;\t/* into bitmaps */\n" );
+  (void) fprintf ( fout, "  unsigned short width;\t/* 0 if no bitmap */\n" );
+  (void) fprintf ( fout, "  unsigned short height;\n" );
+  (void) fprintf ( fout, "  short          xoff;\n" );
+  (void) fprintf ( fout, "  short          yoff;\n" );
+  (void) fprintf ( fout, "  short          advance;\n" );
+  (void) fprintf ( fout, "} mac2bdf_glyph;\n" );
+  (void) fprintf ( fout, "#endif\n\n" );
+  (void) fprintf ( fout, "#define %s_ASCENT\t%d\n", id, ascent );
+  (void) fprintf ( fout, "#define %s_DESCENT\t%d\n", id, descent );
+  (void) fprintf ( fout, "#define %s_FIRST\t%d\n", id, first );
+  (void) fprintf ( fout, "#define %s_LAST\t%d\n", id, last );
+  (void) fprintf ( fout, "#define %s_GLYPH(c)\t( ( (c) >= %d && (c) <= %d ) ? & %s_glyphs [ (c) - %d ] : 0 )\n\n",
+		   id, first, last, id, first );
+
+  /*
+   * Bitmaps: rows MSB first, each padded to a byte.
+   */
+  (void) fprintf ( fout, "static const unsigned char %s_bitmaps [] = {\n", id );
+  for ( i = 0, off = 0; i < n; i++ ) {
+    gp = fglyphs [ i ].glyph;
+    for ( j = 0; ( j < i ) && ( fglyphs [ j ].glyph != gp ); j++ )
+      ;
+    if ( j < i ) {
+      offsets [ i ] = offsets [ j ];
+      continue;
+    }
+    offsets [ i ] = off;
+    (void) fprintf ( fout, "  /* 0x%02x */", fglyphs [ i ].code );
+    for ( k = 0; k < gp->nbytes; k++ )
+      (void) fprintf ( fout, "%s0x%02x,",
+		       ( k && ! ( k % 12 ) ) ? "\n\t     " : " ",
+		       gp->bits [ k ] );
+    (void) fprintf ( fout, "\n" );
+    off += gp->nbytes;
+  }
+  if ( ! off )
+    (void) fprintf ( fout, "  0\n" );
+  (void) fprintf ( fout, "};\n\n" );
+
+  /*
+   * Metrics, one per code from first to last.
+   */
+  (void) fprintf ( fout, "static const mac2bdf_glyph %s_glyphs [] = {\n", id );
+  for ( i = first, j = 0; i <= last; i++ ) {
+    if ( ( j < n ) && ( fglyphs [ j ].code == i ) ) {
+      gp = fglyphs [ j ].glyph;
+      (void) fprintf ( fout, "  { %5ld, %3d, %3d, %3d, %3d, %3d },\t/* 0x%02x */\n",
+		       offsets [ j ], gp->width, gp->height,
+		       gp->xoff, gp->yoff, gp->advance, i );
+      j++;
+    } else
+      (void) fprintf ( fout, "  { %5d, %3d, %3d, %3d, %3d, %3d },\t/* 0x%02x */\n",
+		       0, 0, 0, 0, 0, 0, i );
+  }
+  (void) fprintf ( fout, "};\n" );
+  (void) fclose ( fout );
+  free ( (char *) offsets );
+  ManifestAddOutput ( manifestcur, fname );
+  return 1;
+}
+
+/*
+ * Compress the N bytes at IP with PackBits into OP, which must have room
+ * for N + ( N + 127 ) / 128 bytes.  Returns the compressed length.
+ */
+int
+  PackBits ( ip, n, op )
+register CARD8 * ip;
+int		 n;
+register CARD8 * op;
+{
+  register int	i, r;
+  CARD8 *	o0 = op;
+
+  for ( i = 0; i < n; ) {
+    for ( r = 1; ( i + r < n ) && ( r < 128 ) && ( ip [ i + r ] == ip [ i ] ); r++ )
+      ;
+    if ( r > 1 ) {
+      *op++ = (CARD8) ( 1 - r );
+      *op++ = ip [ i ];
+      i += r;
+      continue;
+    }
+
+    /*
+     * Literal run, ending before the next repeat of three or more.
+     */
+    for ( r = 1; ( i + r < n ) && ( r < 128 ); r++ )
+      if ( ( i + r + 2 < n ) && ( ip [ i + r ] == ip [ i + r + 1 ] ) &&
+	   ( ip [ i + r ] == ip [ i + r + 2 ] ) )
+	break;
+    *op++ = (CARD8) ( r - 1 );
+    (void) memcpy ( (char *) op, (char *) & ip [ i ], r );
+    op += r;
+    i  += r;
+  }
+  return op - o0;
+}
+
+/*
+ * Write the N glyphs of FGLYPHS as MFNT binary font NAME.mfn, with
+ * PackBits compressed bitmaps if packbinary is set.  Glyphs of deep
+ * fonts are written as ink levels.  Returns 1 for success, 0 for
+ * failure.
+ */
+int
+  BinaryDump ( name, fglyphs, n, ascent, descent )
+char *	  name;
+FontGlyph fglyphs;
+int	  n;
+int	  ascent;
+int	  descent;
+{
+  register int	i, j, k;
+  register Glyph gp;
+  MfntHdr  mh;
+  CARD8 *  ob;
+  CARD8 *  data;
+  long	   size, off, bits;
+  int	   first, last, ng, gray, nbytes;
+  FILE *   fout;
+  char	   fname [ 1024 ];
+
+  if ( ! n )
+    return 1;
+  first = fglyphs [ 0	  ].code;
+  last	= fglyphs [ n - 1 ].code;
+  ng	= last - first + 1;
+
+  /*
+   * Size output for the worst case of incompressible bitmaps.
+   */
+  for ( i = 0, gray = 0; i < n; i++ )
+    if ( fglyphs [ i ].glyph->gray )
+      gray = 1;
+  for ( i = 0, bits = 0; i < n; i++ ) {
+    gp	   = fglyphs [ i ].glyph;
+    nbytes = gray ? gp->width * gp->height : gp->nbytes;
+    bits  += nbytes + ( nbytes + 127 ) / 128;
+  }
+  size = MFNTALIGN ( sizeof (MfntHdrRec) );
+  size = MFNTALIGN ( size + ng * sizeof (unsigned int) );
+  size = MFNTALIGN ( size + ng * sizeof (unsigned short) );
+  size = MFNTALIGN ( size + ng * sizeof (unsigned short) );
+  size = MFNTALIGN ( size + ng * sizeof (short) );
+  size = MFNTALIGN ( size + ng * sizeof (short) );
+  size = MFNTALIGN ( size + ng * sizeof (short) );
+  size = MFNTALIGN ( size + bits );
+  if ( ! ( ob = (CARD8 *) calloc ( size, 1 ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: binary font\n", progname );
+    return 0;
+  }
+
+  mh = (MfntHdr) ob;
+  (void) memcpy ( mh->mhMagic, MFNTMAGIC, 4 );
+  mh->mhByteOrder  = MFNTBYTEORDER;
+  mh->mhVersion	   = MFNTVERSION;
+  mh->mhFlags	   = ( packbinary ? MFNT_PACKBITS : 0 ) | ( gray ? MFNT_GRAY8 : 0 );
+  mh->mhFirst	   = first;
+  mh->mhLast	   = last;
+  mh->mhAscent	   = ascent;
+  mh->mhDescent	   = descent;
+  mh->mhBitsOff	   = off = MFNTALIGN ( sizeof (MfntHdrRec) );
+  mh->mhWidthOff   = off = MFNTALIGN ( off + ng * sizeof (unsigned int) );
+  mh->mhHeightOff  = off = MFNTALIGN ( off + ng * sizeof (unsigned short) );
+  mh->mhXOffOff	   = off = MFNTALIGN ( off + ng * sizeof (unsigned short) );
+  mh->mhYOffOff	   = off = MFNTALIGN ( off + ng * sizeof (short) );
+  mh->mhAdvanceOff = off = MFNTALIGN ( off + ng * sizeof (short) );
+  mh->mhBitmapOff  = off = MFNTALIGN ( off + ng * sizeof (short) );
+
+  for ( i = 0; i < ng; i++ )
+    ( (unsigned int *) & ob [ mh->mhBitsOff ] ) [ i ] = MFNT_NOGLYPH;
+
+  /*
+   * Metrics and bitmaps, sharing identical glyphs.
+   */
+  for ( i = 0, bits = 0; i < n; i++ ) {
+    gp = fglyphs [ i ].glyph;
+    k  = fglyphs [ i ].code - first;
+    for ( j = 0; ( j < i ) && ( fglyphs [ j ].glyph != gp ); j++ )
+      ;
+    if ( j < i )
+      ( (unsigned int *) & ob [ mh->mhBitsOff ] ) [ k ] =
+	( (unsigned int *) & ob [ mh->mhBitsOff ] ) [ fglyphs [ j ].code - first ];
+    else {
+      ( (unsigned int *) & ob [ mh->mhBitsOff ] ) [ k ] = bits;
+      data   = gray ? gp->gray : gp->bits;
+      nbytes = gray ? gp->width * gp->height : gp->nbytes;
+      if ( packbinary )
+	bits += PackBits ( data, nbytes, & ob [ off + bits ] );
+      else {
+	(void) memcpy ( (char *) & ob [ off + bits ], (char *) data, nbytes );
+	bits += nbytes;
+      }
+    }
+    ( (unsigned short *) & ob [ mh->mhWidthOff	 ] ) [ k ] = gp->width;
+    ( (unsigned short *) & ob [ mh->mhHeightOff	 ] ) [ k ] = gp->height;
+    ( (short *)		 & ob [ mh->mhXOffOff	 ] ) [ k ] = gp->xoff;
+    ( (short *)		 & ob [ mh->mhYOffOff	 ] ) [ k ] = gp->yoff;
+    ( (short *)		 & ob [ mh->mhAdvanceOff ] ) [ k ] = gp->advance;
+  }
+  mh->mhBitmapLen = bits;
+  size = MFNTALIGN ( off + bits );
+
+  (void) sprintf ( fname, "%s.mfn", name );
+  if ( ! ( fout = fopen ( fname, "wb" ) ) ) {
+    (void) fprintf ( stderr, "%s: can't create output file \"%s\"\n",
+		     progname, fname );
+    free ( (char *) ob );
+    return 0;
+  }
+  if ( ! quiet )
+    (void) printf  ( "Dumping %d glyphs to \"%s\"\n", n, fname );
+  (void) fwrite ( (char *) ob, 1, size, fout );
+  (void) fclose ( fout );
+  free ( (char *) ob );
+  ManifestAddOutput ( manifestcur, fname );
+  return 1;
+}
+
+/*
+ * Dump font FP, a resource of LENGTH bytes, with color table CTAB of
+ * CTABLEN bytes if the font has one, else NULL.  FULLNAME is the font's
+ * canonical name, including style, from which all output names derive.
+ */
+int
+  FontDump ( fp, length, ctab, ctablen, fullname, style, size )
+FontRsrc fp;
+int	 length;
+CARD8 *	 ctab;
+int	 ctablen;
+char *	 fullname;
+int	 style;
+int	 size;
+{
+  register int i, j, bit;
+  register CARD8 * gp;
+  CARD16   g, fg, lg, coff0, coff1, ow, gh;
+  INT16    mk, ht, rw, top, bot, left, right, ng, htop, hbot;
+  CARD8 *  bitImage;
+  CARD8 *  rowbuf;
+  CARD8 *  graybuf;
+  char *   hexbuf;
+  char *   hp;
+  int	   nb, nbmax, nr, nfg, sinks, usecache;
+  int	   spacing, avgwidth, stride, owall;
+  Glyph	   glyph;
+  FontGlyph fglyphs;
+  FontTablesRec tables;
+  FILE *   fout;
+  char	   fontname [ 128 ];
+  char 	   fname [ 128 ];
+  char	   cname [ 1024 ];
+
+  if ( ! fp || ! fullname || ! size )
+    return 1;
+
+  fg = toushort ( fp->ftFirstChar   );
+  lg = toushort ( fp->ftLastChar    );
+  mk = toshort  ( fp->ftKernMax     );
+  ht = toshort  ( fp->ftFRectHeight );
+  rw = toshort  ( fp->ftRowWords    );
+
+  bitImage = (CARD8 *) & fp [ 1 ];
+
+  /*
    * If no glyphs are present, don't dump anything.
    */
   if ( lg == fg )
@@ -428,7 +3449,42 @@ int	 size;
   /*
    * At least one glyph is present; create BDF file.
    */
-  (void) sprintf ( fname, "%s%s-%d.bdf", name, FontStyleName ( style ), size );
+  (void) sprintf ( fontname, "%.100s-%d", fullname, size );
+  (void) sprintf ( fname, "%.120s.bdf", fontname );
+
+  /*
+   * Reuse cached output if font is unchanged.
+   */
+  if ( ! FontTablesLoad ( fp, length, & tables ) )
+    return 0;
+  if ( ( tables.depth > 1 ) && ctab &&
+       ! FontColorTable ( & tables, ctab, ctablen ) )
+    (void) fprintf ( stderr, "%s: warning: bad font color table, using gray levels\n",
+		     progname );
+
+  sinks	   = GLYPHSINKS;
+  usecache = cachedir && ! sinks;
+  if ( usecache ) {
+    FontCacheName ( fp, & tables, fullname, style, size, cname );
+    if ( FontCacheFetch ( cname, fname ) ) {
+      cachehits++;
+      if ( ! quiet )
+	(void) printf  ( "Reusing cached \"%s\"\n", fname );
+      ManifestAddOutput ( manifestcur, fname );
+      return 1;
+    }
+    cachemisses++;
+  }
+
+  if ( ! kernels && ! KernelSelect ( kerneltier ) )
+    return 0;
+
+  /*
+   * Any existing output is removed first, whether or not the cache is in
+   * use, since it may be a hard link to a cache entry that writing in
+   * place would corrupt.
+   */
+  (void) unlink ( fname );
   if ( ! ( fout = fopen ( fname, "w+" ) ) ) {
     (void) fprintf ( stderr, "%s: can't create output file \"%s\"\n",
 		    progname, fname );
@@ -438,75 +3494,147 @@ int	 size;
   /*
    * Obtain per-font information and dump BDF font header.
    */
-  FontInfo ( fp, & top, & left, & bot, & right, & ng );
+  FontInfo ( fp, & tables, & top, & left, & bot, & right, & ng );
+  spacing = FontSpacing ( fp, & tables, & avgwidth, & stride, & owall );
 
   if ( ! quiet )
-    (void) printf  ( "Dumping %d glyphs to \"%s%s-%d.bdf\"\n",
-		     ng, name, FontStyleName ( style ), size );
+    (void) printf  ( "Dumping %d glyphs to \"%s\"\n", ng, fname );
 
   (void) fprintf ( fout, "STARTFONT 2.1\n" );
-  (void) fprintf ( fout, "FONT %s%s-%d\n",
-		   name, FontStyleName ( style ), size );
+  (void) fprintf ( fout, "FONT %s\n", fontname );
   (void) fprintf ( fout, "SIZE %d %d %d\n", size, DEVXRES, DEVYRES );
   (void) fprintf ( fout, "FONTBOUNDINGBOX %d %d %d %d\n",
 		   ( right - left ) + 1,
 		   ( bot - top ) + 1,
 		   mk,
 		   ( ht - toshort ( fp->ftDescent ) ) - ( bot + 1 ) );
-  (void) fprintf ( fout, "STARTPROPERTIES 2\n" );
+  (void) fprintf ( fout, "STARTPROPERTIES 4\n" );
   (void) fprintf ( fout, "FONT_ASCENT %d\n", toshort  ( fp->ftAscent ) );
   (void) fprintf ( fout, "FONT_DESCENT %d\n", toshort  ( fp->ftDescent ) );
+  (void) fprintf ( fout, "SPACING \"%c\"\n", spacing );
+  (void) fprintf ( fout, "AVERAGE_WIDTH %d\n", avgwidth );
   (void) fprintf ( fout, "ENDPROPERTIES\n" );
   (void) fprintf ( fout, "CHARS %d\n", ng );
 
-  if ( (CARD32) bitImage & 0x1 ) {
-    bp = (CARD16 *) alloca ( ht * rw * 2 );
-    (void) memcpy ( (char *) bp, (char *) bitImage, ht * rw * 2 );
-  } else
-    bp = (CARD16 *) bitImage;
-
-  gp = (CARD8 *) alloca ( wd * ht );
-  (void) memset ( (char *) gp, 0, wd * ht );
+  /*
+   * Scratch is sized by the widest glyph, not the strike: packed rows
+   * for one glyph, and hex lines for all of its rows, each with room for
+   * vector kernels' overrun.  Memory stays flat however many glyphs the
+   * strike holds.
+   */
+  nbmax	 = ( tables.maxwidth + 7 ) >> 3;
+  rowbuf  = (CARD8 *) malloc ( nbmax * ht + 16 );
+  hexbuf  = (char *) malloc ( ( ( nbmax << 1 ) + 1 ) * ht + 32 );
+  graybuf = (CARD8 *) malloc ( ( tables.depth > 1 ) ?
+			       tables.maxwidth * ht + 1 : 1 );
+  if ( ! rowbuf || ! hexbuf || ! graybuf ) {
+    (void) fprintf ( stderr, "%s: out of memory: glyph rows\n", progname );
+    if ( rowbuf )
+      free ( (char *) rowbuf );
+    if ( hexbuf )
+      free ( hexbuf );
+    if ( graybuf )
+      free ( (char *) graybuf );
+    (void) fclose ( fout );
+    return 0;
+  }
+  nfg	  = 0;
+  fglyphs = (FontGlyph) alloca ( ( lg - fg + 1 ) * sizeof (FontGlyphRec) );
 
+  coff1 = tables.loc [ 0 ];
   for ( g = fg; g <= lg; g++ ) {
 
     /*
-     * Get starting and ending offset columns in bit image.
+     * Get starting and ending offset columns in bit image; a uniformly
+     * advancing location table, as in most fixed width fonts, is just
+     * stepped through.
      */
-    coff0 = toushort ( & locTable [ ( ( g - fg ) + 0 ) << 1 ] );
-    coff1 = toushort ( & locTable [ ( ( g - fg ) + 1 ) << 1 ] );
-    if ( coff0 == coff1 )
-      continue;
+    if ( stride ) {
+      coff0  = coff1;
+      coff1 += stride;
+    } else {
+      coff0 = tables.loc [ ( g - fg ) + 0 ];
+      coff1 = tables.loc [ ( g - fg ) + 1 ];
+    }
 
     /*
-     * Get basepoint offset and escapement.
+     * Get basepoint offset and escapement, shared by all glyphs of a
+     * character cell font.
      */
-    ow    = toushort ( & owTable  [ ( g - fg ) << 1 ] );
+    if ( stride && ( owall >= 0 ) )
+      ow = owall;
+    else
+      ow = tables.ow [ g - fg ];
 
     /*
-     * Extract glyph image.
+     * A character with an empty image, such as space, has no BDF bitmap,
+     * but unless it is missing, with an offset/width of -1, it goes to
+     * the glyph sinks as a 0x0 glyph keeping its escapement.
      */
-    (void) memset ( (char *) gp, 0, wd * ht );
-    for ( i = 0; i < ht; i++ ) {
-      for ( j = coff0; j < coff1; j++ ) {
-        bit = ( bp [ i * rw + ( j / 16 ) ] >> ( 15 - ( j % 16 ) ) ) & 1;
-	gp [ i * wd + ( j - coff0 ) ] = bit;
-      }
+    if ( coff0 >= coff1 ) {
+      if ( ( ow == 0xffff ) || ! ( dedupglyphs || sinks ) )
+	continue;
+      glyph = GlyphIntern ( rowbuf, 0,
+			    ( tables.depth > 1 ) ? graybuf : (CARD8 *) NULL,
+			    0, 0, 0, 0, ow & 0xff );
+      if ( ! glyph )
+	sinks = 0;
+      fglyphs [ nfg   ].code  = g;
+      fglyphs [ nfg++ ].glyph = glyph;
+      continue;
     }
+
+    /*
+     * Extract glyph image as packed rows: byte-aligned glyphs by copying,
+     * narrow ones by a single fetch per row, others a byte at a time, and
+     * those of deep fonts by thresholding their ink levels.
+     */
+    nb = ( ( coff1 - coff0 ) + 7 ) >> 3;
+    if ( tables.depth > 1 )
+      GlyphGray ( bitImage, rw << 1, coff0, coff1, ht, & tables, graybuf,
+		  rowbuf );
+    else if ( ! ( coff0 & 7 ) )
+      GlyphRowsAligned ( bitImage, rw << 1, coff0, coff1, ht, rowbuf );
+    else if ( nb < (int) NGLYPHROWS )
+      ( *glyphrows [ nb ] ) ( bitImage, rw << 1, coff0, coff1, ht, rowbuf );
+    else
+      ( *kernels->extract ) ( bitImage, rw << 1, coff0, coff1, ht, rowbuf );
     
     /*
-     * Find top and bottom of bounding box.
+     * Find top and bottom of bounding box, trusting the glyph height
+     * table when present, which gives the first non-blank row in its
+     * high byte and the number of rows in its low byte.
      */
-    top = ht;
-    bot = 0;
-    for ( i = 0; i < ht; i++ ) {
-      for ( j = 0; j < wd; j++ ) {
-	bit = gp [ i * wd + j ];
+    htop = -1;
+    hbot = -1;
+    if ( tables.hasht ) {
+      gh = tables.ht [ g - fg ];
+      if ( ! ( gh & 0xff ) ) {
+	htop = ht;
+	hbot = 0;
+      } else if ( ( ( gh >> 8 ) + ( gh & 0xff ) ) <= ht ) {
+	htop = gh >> 8;
+	hbot = htop + ( gh & 0xff ) - 1;
+      }
+    }
+    if ( ( htop >= 0 ) && ! verifyheights ) {
+      top = htop;
+      bot = hbot;
+    } else {
+      top = ht;
+      bot = 0;
+      for ( i = 0; i < ht; i++ ) {
+	for ( j = 0, bit = 0; j < nb; j++ )
+	  bit |= rowbuf [ i * nb + j ];
 	if ( bit && ( i < top ) )
 	  top = i;
 	if ( bit && ( i > bot ) )
 	  bot = i;
       }
+      if ( ( htop >= 0 ) && ( ( htop != top ) || ( hbot != bot ) ) )
+	(void) fprintf ( stderr,
+			 "%s: warning: glyph 0x%02x height table mismatch, got %d-%d, expected %d-%d\n",
+			 progname, g, htop, hbot, top, bot );
     }
     
     (void) fprintf ( fout, "STARTCHAR GCID%02X\n", g );
@@ -519,24 +3647,441 @@ int	 size;
 	     ( ( ow >> 8 ) & 0xff ) + mk,
 	     ( ht - toshort ( fp->ftDescent ) ) - ( bot + 1 ) );
     (void) fprintf ( fout, "BITMAP\n" );
-    for ( i = top; i <= bot; i++ ) {
-      for ( j = 0, bits = 0; j < ( coff1 - coff0 ); j++, bits <<= 1 ) {
-	bits |= gp [ i * wd + j ];
-	if ( ( j & 7 ) == 7 ) {
-	  (void) fprintf ( fout, "%02x", bits );
-	  bits = 0;
+
+    /*
+     * Emit the cropped rows as hex lines.
+     */
+    nr = ( top <= bot ) ? ( bot - top ) + 1 : 0;
+    for ( i = top, hp = hexbuf; i <= bot; i++ )
+      hp += ( *kernels->hexrow ) ( & rowbuf [ i * nb ], nb, hp );
+    (void) fwrite ( hexbuf, 1, hp - hexbuf, fout );
+    (void) fprintf ( fout, "ENDCHAR\n" );
+
+    if ( dedupglyphs || sinks ) {
+
+      /*
+       * Glyphs of deep fonts keep every row with any ink, however faint.
+       */
+      if ( tables.depth > 1 ) {
+	top = ht;
+	bot = 0;
+	for ( i = 0, gp = graybuf; i < ht; i++, gp += coff1 - coff0 ) {
+	  for ( j = 0; ( j < coff1 - coff0 ) && ! gp [ j ]; j++ )
+	    ;
+	  if ( ( j < coff1 - coff0 ) && ( i < top ) )
+	    top = i;
+	  if ( j < coff1 - coff0 )
+	    bot = i;
 	}
+	nr = ( top <= bot ) ? ( bot - top ) + 1 : 0;
       }
-      bits <<= 7 - ( j % 8 );
-      if ( j & 7 )
-	(void) fprintf ( fout, "%02x\n", bits );
-      else
-	(void) fprintf ( fout, "\n" );
+      glyph = GlyphIntern ( & rowbuf [ top * nb ], nb * nr,
+			    ( tables.depth > 1 ) ?
+			    & graybuf [ top * ( coff1 - coff0 ) ] :
+			    (CARD8 *) NULL,
+			    coff1 - coff0, nr,
+			    ( ( ow >> 8 ) & 0xff ) + mk,
+			    ( ht - toshort ( fp->ftDescent ) ) - ( bot + 1 ),
+			    ow & 0xff );
+      if ( ! glyph )
+	sinks = 0;
+      fglyphs [ nfg   ].code  = g;
+      fglyphs [ nfg++ ].glyph = glyph;
     }
-    (void) fprintf ( fout, "ENDCHAR\n" );
   }
   (void) fprintf ( fout, "ENDFONT\n" );
   (void) fclose ( fout );
+  free ( (char *) rowbuf );
+  free ( (char *) graybuf );
+  free ( hexbuf );
+
+  /*
+   * Feed extracted glyphs to any other output modes.
+   */
+  if ( sinks && atlasfonts )
+    (void) AtlasDump ( fontname, fglyphs, nfg,
+		       toshort ( fp->ftAscent ), toshort ( fp->ftDescent ) );
+  if ( sinks && ctablefonts )
+    (void) CTableDump ( fontname, fglyphs, nfg,
+			toshort ( fp->ftAscent ), toshort ( fp->ftDescent ) );
+  if ( sinks && binaryfonts )
+    (void) BinaryDump ( fontname, fglyphs, nfg,
+			toshort ( fp->ftAscent ), toshort ( fp->ftDescent ) );
+
+  if ( usecache && ! FontCacheStore ( fname, cname ) )
+    (void) fprintf ( stderr, "%s: warning: can't cache \"%s\"\n",
+		     progname, fname );
+  ManifestAddOutput ( manifestcur, fname );
+  return 1;
+}
+
+
+/*
+ * Order kerning pairs by first, then second character.
+ */
+int
+  MetricsPairCompare ( a, b )
+const void * a;
+const void * b;
+{
+  register MetricsPair pa = (MetricsPair) a;
+  register MetricsPair pb = (MetricsPair) b;
+
+  if ( pa->mpFirst != pb->mpFirst )
+    return (int) pa->mpFirst - (int) pb->mpFirst;
+  return (int) pa->mpSecond - (int) pb->mpSecond;
+}
+
+#define METRICSALIGN(n)	( ( (n) + 3 ) & ~3 )
+
+/*
+ * Decode FOND family character-width and kerning tables of FOND FP, of
+ * LENGTH bytes, and write them as metrics sidecar NAME.fmx.  Returns 1
+ * if written or if there are no such tables, 0 on failure.
+ */
+int
+  FondMetricsDump ( fp, length, name )
+FondRsrc fp;
+int	 length;
+char *	 name;
+{
+  register CARD8 *tp;
+  register int i, n;
+  CARD8 *  fb = (CARD8 *) fp;
+  CARD8 *  ob;
+  CARD32   woff, koff, off;
+  unsigned long size;
+  MetricsHdr mh;
+  MetricsKern mk;
+  MetricsPair mp;
+  CARD16 * index;
+  int	   c, nc, nw, nk, np, ntotal, ok;
+  FILE *   fout;
+  char	   fname [ 1024 ];
+
+  if ( length < (int) sizeof (FondRsrcRec) )
+    return 0;
+  woff = toulong ( fp->fdWTabOff );
+  koff = toulong ( fp->fdKernOff );
+  nc   = toushort ( fp->fdLast ) - toushort ( fp->fdFirst ) + 3;
+  if ( ( ! woff && ! koff ) || ( nc < 2 ) )
+    return 1;
+
+  /*
+   * Validate tables and size sidecar.  Widths are for characters 0-255
+   * at most, and all sizes are computed unsigned long, so a corrupt FOND
+   * can't wrap them.
+   */
+  if ( nc > MAXFONTTABLE )
+    goto bad;
+  nw = 0;
+  if ( woff ) {
+    if ( woff > (CARD32) length - 2 )
+      goto bad;
+    nw = toshort ( & fb [ woff ] ) + 1;
+    if ( ( nw < 0 ) ||
+	 ( (unsigned long) nw * ( 2 + nc * 2 ) >
+	   (unsigned long) ( (CARD32) length - woff - 2 ) ) )
+      goto bad;
+  }
+  nk = ntotal = 0;
+  if ( koff ) {
+    if ( koff > (CARD32) length - 2 )
+      goto bad;
+    nk = toshort ( & fb [ koff ] ) + 1;
+    if ( nk < 0 )
+      goto bad;
+    for ( n = 0, tp = & fb [ koff + 2 ]; n < nk; n++ ) {
+      if ( & fb [ length ] - tp < 4 )
+	goto bad;
+      np  = toushort ( & tp [ 2 ] );
+      if ( (unsigned long) np * 4 > (unsigned long) ( & fb [ length ] - tp - 4 ) )
+	goto bad;
+      tp += 4 + np * 4;
+      ntotal += np;
+    }
+  }
+
+  size = METRICSALIGN ( (unsigned long) sizeof (MetricsHdrRec) );
+  size = METRICSALIGN ( size + (unsigned long) nw * sizeof (CARD16) );
+  size = METRICSALIGN ( size + (unsigned long) nw * nc * sizeof (INT16) );
+  size = METRICSALIGN ( size + (unsigned long) nk * sizeof (MetricsKernRec) );
+  size = size + (unsigned long) nk * METRICSALIGN ( 257 * sizeof (CARD16) ) +
+    (unsigned long) ntotal * sizeof (MetricsPairRec);
+  if ( size != (CARD32) size )
+    goto bad;
+  if ( ! ( ob = (CARD8 *) calloc ( size, 1 ) ) ) {
+    (void) fprintf ( stderr, "%s: out of memory: metrics\n", progname );
+    return 0;
+  }
+
+  mh = (MetricsHdr) ob;
+  (void) memcpy ( mh->mhMagic, METRICSMAGIC, 4 );
+  mh->mhByteOrder = 0x0102;
+  mh->mhVersion   = METRICSVERSION;
+  mh->mhFamID     = toshort  ( fp->fdFamID );
+  mh->mhFirst     = toushort ( fp->fdFirst );
+  mh->mhLast      = toushort ( fp->fdLast  );
+  mh->mhNWidths   = nw;
+  mh->mhNKerns    = nk;
+  off = METRICSALIGN ( sizeof (MetricsHdrRec) );
+
+  /*
+   * Width tables: array of styles, then array of width rows.
+   */
+  mh->mhWidthOff = off;
+  for ( n = 0, tp = & fb [ woff + 2 ]; n < nw; n++ ) {
+    ( (CARD16 *) & ob [ off ] ) [ n ] = toushort ( tp );
+    tp += 2 + nc * 2;
+  }
+  off = METRICSALIGN ( off + nw * sizeof (CARD16) );
+  for ( n = 0, tp = & fb [ woff + 2 ]; n < nw; n++ ) {
+    for ( i = 0; i < nc; i++ )
+      ( (INT16 *) & ob [ off ] ) [ n * nc + i ] =
+	toshort ( & tp [ 2 + i * 2 ] );
+    tp += 2 + nc * 2;
+  }
+  off = METRICSALIGN ( off + nw * nc * sizeof (INT16) );
+
+  /*
+   * Kerning tables: descriptors, then each table's index and pairs.
+   */
+  mh->mhKernOff = off;
+  mk  = (MetricsKern) & ob [ off ];
+  off = METRICSALIGN ( off + nk * sizeof (MetricsKernRec) );
+  for ( n = 0, tp = & fb [ koff + 2 ]; n < nk; n++ ) {
+    np = toushort ( & tp [ 2 ] );
+    mk [ n ] . mkStyle    = toushort ( tp );
+    mk [ n ] . mkNPairs   = np;
+    mk [ n ] . mkIndexOff = off;
+    index = (CARD16 *) & ob [ off ];
+    off = METRICSALIGN ( off + 257 * sizeof (CARD16) );
+    mk [ n ] . mkPairOff  = off;
+    mp  = (MetricsPair) & ob [ off ];
+    for ( tp += 4, i = 0; i < np; i++, tp += 4 ) {
+      mp [ i ] . mpFirst  = tp [ 0 ];
+      mp [ i ] . mpSecond = tp [ 1 ];
+      mp [ i ] . mpKern   = toshort ( & tp [ 2 ] );
+    }
+    qsort ( (char *) mp, np, sizeof (*mp), MetricsPairCompare );
+    for ( i = 0, c = 0; c < 256; c++ ) {
+      index [ c ] = i;
+      while ( ( i < np ) && ( mp [ i ] . mpFirst == c ) )
+	i++;
+    }
+    index [ 256 ] = np;
+    off += np * sizeof (MetricsPairRec);
+  }
+
+  (void) sprintf ( fname, "%.1000s.fmx", name );
+  if ( ! quiet )
+    (void) printf  ( "Dumping %d width and %d kerning tables to \"%s\"\n",
+		     nw, nk, fname );
+  if ( ! ( fout = fopen ( fname, "w" ) ) ) {
+    (void) fprintf ( stderr, "%s: can't create output file \"%s\"\n",
+		     progname, fname );
+    free ( (char *) ob );
+    return 0;
+  }
+  ok = fwrite ( (char *) ob, size, 1, fout ) == 1;
+  if ( ( fclose ( fout ) != 0 ) || ! ok ) {
+    (void) fprintf ( stderr, "%s: can't write output file \"%s\"\n",
+		     progname, fname );
+    free ( (char *) ob );
+    return 0;
+  }
+  free ( (char *) ob );
+  ManifestAddOutput ( manifestcur, fname );
   return 1;
+
+ bad:
+  (void) fprintf ( stderr, "%s: bad FOND width or kerning table, \"%s\"\n",
+		   progname, name );
+  return 0;
+}
+
+/*
+ * Determine style-mapping table index of STYLE.  Underline is ignored,
+ * being synthesized by QuickDraw; bold, italic, outline, and shadow
+ * select one of 16 entries, and condensed or extended one of three
+ * groups of these.
+ */
+int
+  FondStyleIndex ( style )
+int style;
+{
+  register int n;
+
+  n = ( style & 0003 ) | ( ( style & 0030 ) >> 1 );
+  if ( style & 0040 )
+    n += 16;
+  else if ( style & 0100 )
+    n += 32;
+  return n;
+}
+
+/*
+ * Derive family name from FOND resource name FONDNAME, of FONDNAMELEN
+ * bytes, removing any B, I, BI, Sb, or SbI style prefix and replacing
+ * whitespace with hyphens.
+ */
+char *
+  FondFamilyName ( fondname, fondnamelen )
+char *	 fondname;
+int	 fondnamelen;
+{
+  static char *prefixes [] = { "SbI ", "Sb ", "BI ", "B ", "I ", NULL };
+  register char **pp, *cp;
+  char	   namebuf [ 256 ];
+  int	   n;
+
+  (void) strncpy ( namebuf, fondname, fondnamelen );
+  namebuf [ fondnamelen ] = '\0';
+  for ( cp = namebuf, pp = prefixes; *pp; pp++ ) {
+    n = strlen ( *pp );
+    if ( ( strncmp ( namebuf, *pp, n ) == 0 ) && namebuf [ n ] ) {
+      cp = & namebuf [ n ];
+      break;
+    }
+  }
+  cp = strdup ( cp );
+  for ( fondname = cp; *fondname; fondname++ )
+    if ( isspace ( (unsigned char) *fondname ) )
+      *fondname = '-';
+  return cp;
+}
+
+/*
+ * Compose canonical names for all styles of FOND FP, of LENGTH bytes,
+ * from the style-mapping table's base name and suffix strings.  Styles
+ * without an entry are named from FAMILY and FontStyleName.  NAMES has
+ * NSTYLEINDEX entries, filled in lazily as STYLE is requested, so each
+ * name is built once per FOND.
+ */
+char *
+  FondStyleName ( fp, length, family, style, names )
+FondRsrc fp;
+int	 length;
+char *	 family;
+int	 style;
+char **	 names;
+{
+  register CARD8 *sp, *tp;
+  CARD8 *  strs [ 256 ];
+  CARD8 *  fb = (CARD8 *) fp;
+  CARD32   soff;
+  char	   namebuf [ 256 ];
+  char *   sname;
+  int	   n, ns, si, idx, len;
+
+  si = FondStyleIndex ( style );
+  if ( names [ si ] )
+    return names [ si ];
+
+  /*
+   * Style-mapping table: class, encoding offset, reserved, 48 indices,
+   * then string count and strings.
+   */
+  soff = toulong ( fp->fdStylOff );
+  idx  = 0;
+  if ( soff && ( soff + 60 <= (CARD32) length ) ) {
+    sp  = & fb [ soff ];
+    idx = sp [ 10 + si ];
+    ns  = toshort ( & sp [ 58 ] );
+    if ( ns > 256 )
+      ns = 256;
+    for ( n = 0, tp = & sp [ 60 ]; n < ns; n++ ) {
+      if ( ( tp >= & fb [ length ] ) ||
+	   ( tp + 1 + tp [ 0 ] > & fb [ length ] ) )
+	break;
+      strs [ n ] = tp;
+      tp += 1 + tp [ 0 ];
+    }
+    ns = n;
+    if ( ! ns || ( idx > ns ) )
+      idx = 0;
+  }
+
+  if ( idx ) {
+    len = strs [ 0 ] [ 0 ];
+    (void) memcpy ( namebuf, (char *) & strs [ 0 ] [ 1 ], len );
+    if ( idx > 1 ) {
+      for ( sp = strs [ idx - 1 ], n = 1; n <= sp [ 0 ]; n++ ) {
+	if ( ( sp [ n ] < 1 ) || ( sp [ n ] > ns ) )
+	  continue;
+	tp = strs [ sp [ n ] - 1 ];
+	if ( len + tp [ 0 ] >= (int) sizeof (namebuf) )
+	  break;
+	(void) memcpy ( & namebuf [ len ], (char *) & tp [ 1 ], tp [ 0 ] );
+	len += tp [ 0 ];
+      }
+    }
+    namebuf [ len ] = '\0';
+    for ( n = 0; n < len; n++ )
+      if ( isspace ( (unsigned char) namebuf [ n ] ) )
+	namebuf [ n ] = '-';
+  } else {
+    sname = FontStyleName ( style );
+    (void) sprintf ( namebuf, "%.127s%.127s", family, sname );
+    free ( sname );
+  }
+
+  return names [ si ] = strdup ( namebuf );
+}
+
+void
+  AddFontToFontNames ( fn )
+FontName fn;
+{
+  register FontName *fnp;
+
+  for ( fnp = & fontnames; *fnp; fnp = & (*fnp)->next )
+    continue;
+  *fnp = fn;
 }
 
+/*
+ * Add fonts of FOND FP, of LENGTH bytes, named FONDNAME, to the list of
+ * fonts to dump.  Family and canonical names are computed once for the
+ * FOND and shared by its fonts.
+ */
+void
+  FondAddFonts ( fp, length, fondname, fondnamelen )
+FondRsrc fp;
+int	 length;
+char *	 fondname;
+int	 fondnamelen;
+{
+  register CARD8 *ap;
+  register FontName fn;
+  register int nf, num_fonts;
+  char *   family;
+  char *   names [ NSTYLEINDEX ];
+
+  if ( length < (int) sizeof (FondRsrcRec) + 2 )
+    return;
+  ap = (CARD8 *) & fp [ 1 ];
+  num_fonts = toshort ( ap ) + 1;
+  if ( ( num_fonts <= 0 ) ||
+       ( (int) sizeof (FondRsrcRec) + 2 + num_fonts * 6 > length ) )
+    return;
+
+  family = FondFamilyName ( fondname, fondnamelen );
+  (void) memset ( (char *) names, 0, sizeof (names) );
+  for ( ap += 2, nf = 0; nf < num_fonts; nf++, ap += 6 ) {
+    if ( ! toshort ( & ap [ 0 ] ) )
+      continue;
+    if ( ! ( fn = (FontName) malloc ( sizeof (*fn) ) ) ) {
+      (void) fprintf ( stderr, "%s: out of memory: fond add fonts\n",
+		       progname );
+      return;
+    }
+    fn->name        = family;
+    fn->size        = toshort ( & ap [ 0 ] );
+    fn->style       = toshort ( & ap [ 2 ] );
+    fn->resource_id = toshort ( & ap [ 4 ] );
+    fn->fullname    = FondStyleName ( fp, length, family, fn->style, names );
+    fn->next        = (FontName) NULL;
+    AddFontToFontNames ( fn );
+  }
+}
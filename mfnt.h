@@ -0,0 +1,229 @@
+/*
+ * File:     mfnt.h
+ * Purpose:  Compact binary bitmap font format written by mac2bdf, and a
+ *	     reader for it.
+ * Comments: An MFNT file is designed to be mapped into memory and used
+ *	     in place, without parsing.  It is written in the byte order
+ *	     of the host that produced it; MfntOpen rejects a file of the
+ *	     other byte order.  The file is a header, followed by glyph
+ *	     metrics in struct-of-arrays form, one entry per character
+ *	     code from mhFirst to mhLast, followed by the glyph bitmaps.
+ *	     Every section starts on a 4-byte boundary.
+ *
+ *	     Bitmap rows are MSB first and padded to bytes, as in BDF.
+ *	     If MFNT_GRAY8 is set in mhFlags, as for fonts deeper than 1
+ *	     bit, bitmaps are instead a byte per pixel of ink, from 0 for
+ *	     none to 255 for full.  If MFNT_PACKBITS is set, each glyph's
+ *	     bitmap is compressed with PackBits and MfntUnpack expands it.
+ *	     Glyphs with identical bitmaps share one.
+ *
+ *	     Usage:
+ *
+ *		MfntFont   font;
+ *		MfntGlyph  glyph;
+ *
+ *		if ( MfntOpen ( & font, data, length ) &&
+ *		     MfntGetGlyph ( & font, code, & glyph ) )
+ *		  ...
+ *
+ *	     Define MFNT_NOREADER for the format definitions alone.
+ *	     mfntbench.c times loading an MFNT font against parsing the
+ *	     same font as BDF.
+ */
+
+#ifndef MFNT_H
+#define MFNT_H
+
+#include <stddef.h>
+#include <string.h>
+
+#define  MFNTMAGIC	"MFNT"		/* binary font magic number */
+#define  MFNTVERSION	2		/* binary font format version */
+#define  MFNTBYTEORDER	0x0102		/* byte order marker */
+
+#define  MFNT_PACKBITS	0x0001		/* glyph bitmaps are PackBits */
+#define  MFNT_GRAY8	0x0002		/* glyph bitmaps are 8-bit ink */
+#define  MFNT_NOGLYPH	0xffffffff	/* bitmap offset of missing glyph */
+
+#define  MFNTALIGN(n)	( ( (n) + 3 ) & ~3 )
+
+typedef struct _MfntHdrRec MfntHdrRec, *MfntHdr;
+struct _MfntHdrRec {
+  char		  mhMagic      [   4 ];
+  unsigned short  mhByteOrder;
+  unsigned short  mhVersion;
+  unsigned short  mhFlags;
+  unsigned short  mhFirst;
+  unsigned short  mhLast;
+  short		  mhAscent;
+  short		  mhDescent;
+  unsigned short  mhPad;
+  unsigned int	  mhBitsOff;	/* unsigned int [n], into bitmaps */
+  unsigned int	  mhWidthOff;	/* unsigned short [n] */
+  unsigned int	  mhHeightOff;	/* unsigned short [n] */
+  unsigned int	  mhXOffOff;	/* short [n] */
+  unsigned int	  mhYOffOff;	/* short [n] */
+  unsigned int	  mhAdvanceOff;	/* short [n] */
+  unsigned int	  mhBitmapOff;
+  unsigned int	  mhBitmapLen;
+};
+
+#define MFNTNGLYPHS(mh)	( (mh)->mhLast - (mh)->mhFirst + 1 )
+
+typedef struct _MfntFont MfntFont;
+struct _MfntFont {
+  const unsigned char *	base;
+  const MfntHdrRec *	hdr;
+  const unsigned int *	bits;
+  const unsigned short *width;
+  const unsigned short *height;
+  const short *		xoff;
+  const short *		yoff;
+  const short *		advance;
+  const unsigned char *	bitmaps;
+};
+
+typedef struct _MfntGlyph MfntGlyph;
+struct _MfntGlyph {
+  int			width;
+  int			height;
+  int			xoff;
+  int			yoff;
+  int			advance;
+  int			nbytes;		/* unpacked bitmap size */
+  const unsigned char *	bits;		/* NULL if blank */
+};
+
+#ifndef MFNT_NOREADER
+
+/*
+ * Attach FONT to the LENGTH bytes of MFNT data at DATA, which must be
+ * 4-byte aligned and must outlive FONT.  Returns 1 for success, 0 if the
+ * data is not a valid MFNT font for this host.
+ */
+static int
+  MfntOpen ( MfntFont * font, const void * data, size_t length )
+{
+  const MfntHdrRec * mh = (const MfntHdrRec *) data;
+  const unsigned int * op;
+  size_t   n;
+
+  if ( ( length < sizeof (MfntHdrRec) ) ||
+       memcmp ( mh->mhMagic, MFNTMAGIC, 4 ) ||
+       ( mh->mhByteOrder != MFNTBYTEORDER ) ||
+       ( mh->mhVersion < 1 ) || ( mh->mhVersion > MFNTVERSION ) ||
+       ( mh->mhLast < mh->mhFirst ) )
+    return 0;
+  n = MFNTNGLYPHS ( mh );
+  if ( ( mh->mhBitsOff    + n * sizeof (unsigned int)   > length ) ||
+       ( mh->mhWidthOff   + n * sizeof (unsigned short) > length ) ||
+       ( mh->mhHeightOff  + n * sizeof (unsigned short) > length ) ||
+       ( mh->mhXOffOff    + n * sizeof (short)          > length ) ||
+       ( mh->mhYOffOff    + n * sizeof (short)          > length ) ||
+       ( mh->mhAdvanceOff + n * sizeof (short)          > length ) ||
+       ( mh->mhBitmapOff  + (size_t) mh->mhBitmapLen    > length ) )
+    return 0;
+  for ( op = & mh->mhBitsOff; op <= & mh->mhBitmapOff; op++ )
+    if ( *op & 3 )
+      return 0;
+
+  font->base	= (const unsigned char *) data;
+  font->hdr	= mh;
+  font->bits	= (const unsigned int   *) & font->base [ mh->mhBitsOff    ];
+  font->width	= (const unsigned short *) & font->base [ mh->mhWidthOff   ];
+  font->height	= (const unsigned short *) & font->base [ mh->mhHeightOff  ];
+  font->xoff	= (const short *)	   & font->base [ mh->mhXOffOff    ];
+  font->yoff	= (const short *)	   & font->base [ mh->mhYOffOff    ];
+  font->advance	= (const short *)	   & font->base [ mh->mhAdvanceOff ];
+  font->bitmaps	= & font->base [ mh->mhBitmapOff ];
+  return 1;
+}
+
+/*
+ * Look up the glyph for character CODE of FONT.  Returns 1 and fills in
+ * GLYPH if present, else 0, as also for a glyph whose bitmap would lie
+ * outside the font data.  GLYPH's bits point into the font data.
+ */
+static int
+  MfntGetGlyph ( const MfntFont * font, unsigned int code, MfntGlyph * glyph )
+{
+  unsigned int i, off, len;
+
+  if ( ( code < font->hdr->mhFirst ) || ( code > font->hdr->mhLast ) )
+    return 0;
+  i   = code - font->hdr->mhFirst;
+  off = font->bits [ i ];
+  if ( off == MFNT_NOGLYPH )
+    return 0;
+
+  glyph->width	 = font->width	 [ i ];
+  glyph->height	 = font->height	 [ i ];
+  glyph->xoff	 = font->xoff	 [ i ];
+  glyph->yoff	 = font->yoff	 [ i ];
+  glyph->advance = font->advance [ i ];
+  glyph->nbytes	 = ( ( font->hdr->mhFlags & MFNT_GRAY8 ) ?
+		     glyph->width : ( glyph->width + 7 ) >> 3 ) * glyph->height;
+  glyph->bits	 = (const unsigned char *) 0;
+  if ( ! glyph->nbytes )
+    return 1;
+
+  /*
+   * Packed bitmaps are bounded as MfntUnpack expands them; others must
+   * lie wholly within the bitmap data.
+   */
+  len = font->hdr->mhBitmapLen;
+  if ( ( off >= len ) ||
+       ( ! ( font->hdr->mhFlags & MFNT_PACKBITS ) &&
+	 ( (unsigned int) glyph->nbytes > len - off ) ) )
+    return 0;
+  glyph->bits	 = & font->bitmaps [ off ];
+  return 1;
+}
+
+/*
+ * Expand the bitmap of GLYPH of FONT into the nbytes bytes at OUT.
+ * Returns 1 for success, 0 if the bitmap is corrupt.
+ */
+static int
+  MfntUnpack ( const MfntFont * font, const MfntGlyph * glyph,
+	       unsigned char * out )
+{
+  const unsigned char * ip, * end;
+  int	   n, i, c;
+
+  if ( ! glyph->bits ) {
+    (void) memset ( out, 0, glyph->nbytes );
+    return 1;
+  }
+  if ( ! ( font->hdr->mhFlags & MFNT_PACKBITS ) ) {
+    (void) memcpy ( out, glyph->bits, glyph->nbytes );
+    return 1;
+  }
+
+  ip  = glyph->bits;
+  end = & font->bitmaps [ font->hdr->mhBitmapLen ];
+  for ( i = 0; i < glyph->nbytes; ) {
+    if ( ip >= end )
+      return 0;
+    c = (signed char) *ip++;
+    if ( c >= 0 ) {
+      n = c + 1;
+      if ( ( i + n > glyph->nbytes ) || ( ip + n > end ) )
+	return 0;
+      (void) memcpy ( & out [ i ], ip, n );
+      ip += n;
+    } else if ( c != -128 ) {
+      n = 1 - c;
+      if ( ( i + n > glyph->nbytes ) || ( ip >= end ) )
+	return 0;
+      (void) memset ( & out [ i ], *ip++, n );
+    } else
+      continue;
+    i += n;
+  }
+  return 1;
+}
+
+#endif /* MFNT_NOREADER */
+
+#endif /* MFNT_H */
@@ -0,0 +1,238 @@
+/*
+ * File:     mfntbench.c
+ * Purpose:  Compare loading a font from mac2bdf's MFNT output with
+ *	     parsing the same font's BDF output.
+ * Usage:    mfntbench [-n passes] font.bdf font.mfn
+ * Comments: Both files are read into memory once, so only decoding is
+ *	     timed, as for an MFNT file mapped from the page cache.  Each
+ *	     BDF pass parses every glyph's metrics and hex rows into a
+ *	     glyph table indexed by code, as a BDF loader must; each MFNT
+ *	     pass attaches the font with MfntOpen and fetches every glyph
+ *	     with MfntGetGlyph, expanding it with MfntUnpack only if the
+ *	     font is PackBits compressed.  Reports CPU time per pass.
+ *
+ *	     Build with:  cc -O2 -o mfntbench mfntbench.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mfnt.h"
+
+#define  BENCHPASSES	1000	/* default passes over each font */
+#define  BENCHCODES	65536	/* glyph table entries, for any code */
+
+typedef struct _BenchGlyphRec BenchGlyphRec, *BenchGlyph;
+struct _BenchGlyphRec {
+  int		width;
+  int		height;
+  int		xoff;
+  int		yoff;
+  int		advance;
+  unsigned char *bits;
+};
+
+char *	 progname;
+
+/*
+ * Read all of file NAME into a buffer, 4-byte aligned as MfntOpen
+ * requires, and NUL terminated for parsing.  Returns the buffer and
+ * sets *RET_LENGTH, or returns NULL on failure.
+ */
+char *
+  BenchLoad ( name, ret_length )
+char *	 name;
+size_t * ret_length;
+{
+  FILE *   fp;
+  char *   buf;
+  long	   n;
+
+  if ( ! ( fp = fopen ( name, "rb" ) ) ) {
+    (void) fprintf ( stderr, "%s: can't open \"%s\"\n", progname, name );
+    return (char *) NULL;
+  }
+  if ( ( fseek ( fp, 0L, 2 ) < 0 ) || ( ( n = ftell ( fp ) ) < 0 ) ||
+       ( fseek ( fp, 0L, 0 ) < 0 ) ||
+       ! ( buf = (char *) malloc ( (size_t) n + 1 ) ) ||
+       ( fread ( buf, 1, (size_t) n, fp ) != (size_t) n ) ) {
+    (void) fprintf ( stderr, "%s: can't read \"%s\"\n", progname, name );
+    (void) fclose ( fp );
+    return (char *) NULL;
+  }
+  (void) fclose ( fp );
+  buf [ n ] = '\0';
+  *ret_length = (size_t) n;
+  return buf;
+}
+
+/*
+ * Value of hex digit C.
+ */
+int
+  BenchHex ( c )
+int	 c;
+{
+  if ( ( c >= '0' ) && ( c <= '9' ) )
+    return c - '0';
+  if ( ( c >= 'a' ) && ( c <= 'f' ) )
+    return c - 'a' + 10;
+  if ( ( c >= 'A' ) && ( c <= 'F' ) )
+    return c - 'A' + 10;
+  return 0;
+}
+
+/*
+ * Parse the glyphs of BDF text BDF into GLYPHS, replacing any bitmaps
+ * held from a previous pass.  Returns the number of glyphs parsed.
+ */
+int
+  BenchParseBdf ( bdf, glyphs )
+char *	   bdf;
+BenchGlyph glyphs;
+{
+  register char *cp;
+  register unsigned char *bp;
+  BenchGlyph gp;
+  int	   code, ng, nb, i, j;
+
+  ng   = 0;
+  code = -1;
+  gp   = (BenchGlyph) NULL;
+  for ( cp = bdf; *cp; ) {
+    if ( strncmp ( cp, "ENCODING ", 9 ) == 0 ) {
+      code = atoi ( cp + 9 );
+      gp   = ( ( code >= 0 ) && ( code < BENCHCODES ) ) ?
+	     & glyphs [ code ] : (BenchGlyph) NULL;
+    } else if ( gp && ( strncmp ( cp, "DWIDTH ", 7 ) == 0 ) )
+      gp->advance = atoi ( cp + 7 );
+    else if ( gp && ( strncmp ( cp, "BBX ", 4 ) == 0 ) )
+      (void) sscanf ( cp + 4, "%d %d %d %d",
+		      & gp->width, & gp->height, & gp->xoff, & gp->yoff );
+    else if ( gp && ( strncmp ( cp, "BITMAP", 6 ) == 0 ) ) {
+      nb = ( gp->width + 7 ) >> 3;
+      if ( gp->height < 0 )
+	gp->height = 0;
+      if ( gp->bits )
+	free ( (char *) gp->bits );
+      if ( ! ( gp->bits = (unsigned char *)
+	       malloc ( nb * gp->height + 1 ) ) )
+	return ng;
+      for ( i = 0, bp = gp->bits; i < gp->height; i++ ) {
+	while ( *cp && ( *cp++ != '\n' ) )
+	  ;
+	for ( j = 0; j < nb; j++, cp += 2 )
+	  *bp++ = ( BenchHex ( cp [ 0 ] ) << 4 ) | BenchHex ( cp [ 1 ] );
+      }
+      ng++;
+      gp = (BenchGlyph) NULL;
+    }
+    while ( *cp && ( *cp++ != '\n' ) )
+      ;
+  }
+  return ng;
+}
+
+/*
+ * Attach MFNT font data MFN of LENGTH bytes and fetch every glyph,
+ * expanding bitmaps into *OUT, of *OUTLEN bytes and grown as needed, if
+ * packed.  Returns the number of glyphs fetched, or -1 if the font is
+ * not valid.
+ */
+int
+  BenchLoadMfnt ( mfn, length, out, outlen )
+char *	 mfn;
+size_t	 length;
+unsigned char ** out;
+int *	 outlen;
+{
+  MfntFont font;
+  MfntGlyph glyph;
+  unsigned int code;
+  int	   ng, packed;
+
+  if ( ! MfntOpen ( & font, mfn, length ) )
+    return -1;
+  packed = font.hdr->mhFlags & MFNT_PACKBITS;
+  for ( code = font.hdr->mhFirst, ng = 0; code <= font.hdr->mhLast; code++ ) {
+    if ( ! MfntGetGlyph ( & font, code, & glyph ) )
+      continue;
+    if ( ! packed ) {
+      ng++;
+      continue;
+    }
+    if ( glyph.nbytes > *outlen ) {
+      free ( (char *) *out );
+      if ( ! ( *out = (unsigned char *) malloc ( glyph.nbytes ) ) )
+	return -1;
+      *outlen = glyph.nbytes;
+    }
+    if ( ! MfntUnpack ( & font, & glyph, *out ) )
+      return -1;
+    ng++;
+  }
+  return ng;
+}
+
+int
+  main ( argc, argv )
+int	 argc;
+char **	 argv;
+{
+  BenchGlyph glyphs;
+  unsigned char * out;
+  char *   bdf;
+  char *   mfn;
+  size_t   bdflen, mfnlen;
+  clock_t  t0, t1, t2;
+  int	   i, passes, nbdf, nmfn, outlen;
+
+  progname = argv [ 0 ];
+  passes   = BENCHPASSES;
+  if ( ( argc > 2 ) && ( strcmp ( argv [ 1 ], "-n" ) == 0 ) ) {
+    passes = atoi ( argv [ 2 ] );
+    argc  -= 2;
+    argv  += 2;
+  }
+  if ( ( argc != 3 ) || ( passes < 1 ) ) {
+    (void) fprintf ( stderr, "usage: %s [-n passes] font.bdf font.mfn\n",
+		     progname );
+    return 1;
+  }
+  if ( ! ( bdf = BenchLoad ( argv [ 1 ], & bdflen ) ) ||
+       ! ( mfn = BenchLoad ( argv [ 2 ], & mfnlen ) ) )
+    return 1;
+  glyphs = (BenchGlyph) calloc ( BENCHCODES, sizeof (BenchGlyphRec) );
+  out	 = (unsigned char *) malloc ( outlen = 4096 );
+  if ( ! glyphs || ! out ) {
+    (void) fprintf ( stderr, "%s: out of memory\n", progname );
+    return 1;
+  }
+
+  nbdf = nmfn = 0;
+  t0 = clock ();
+  for ( i = 0; i < passes; i++ )
+    nbdf = BenchParseBdf ( bdf, glyphs );
+  t1 = clock ();
+  for ( i = 0; i < passes; i++ )
+    nmfn = BenchLoadMfnt ( mfn, mfnlen, & out, & outlen );
+  t2 = clock ();
+  if ( nmfn < 0 ) {
+    (void) fprintf ( stderr, "%s: bad MFNT font \"%s\"\n",
+		     progname, argv [ 2 ] );
+    return 1;
+  }
+
+  (void) printf ( "BDF:  %d glyphs, %lu bytes, %.2f us per load\n",
+		  nbdf, (unsigned long) bdflen,
+		  1e6 * ( t1 - t0 ) / CLOCKS_PER_SEC / passes );
+  (void) printf ( "MFNT: %d glyphs, %lu bytes, %.2f us per load\n",
+		  nmfn, (unsigned long) mfnlen,
+		  1e6 * ( t2 - t1 ) / CLOCKS_PER_SEC / passes );
+  if ( t2 > t1 )
+    (void) printf ( "MFNT is %.1fx faster\n",
+		    (double) ( t1 - t0 ) / ( t2 - t1 ) );
+  return 0;
+}